@@ -0,0 +1,379 @@
+// Micro-benchmarks of the pipeline hot paths, on the bundled dataset and on synthetic inputs.
+// Results are written as JSON, to compare builds and catch regressions.
+//
+// Usage: benchmarks [dataset path] [output file] [repetitions]
+
+#include "BoundingBoxes.hpp"
+#include "Segmentation.hpp"
+#include "BitMask.hpp"
+#include "Tray.hpp"
+#include "Classifier.hpp"
+#include "Morphology.hpp"
+#include "Metrics.hpp"
+#include "Utils.hpp"
+#include "Common.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+
+struct Benchmark
+{
+	string name;             // Measured function
+	string input;            // Description of the input set
+	int items;               // Number of inputs processed by each repetition
+	vector<double> times;    // Milliseconds of each repetition
+};
+
+int main(int argc, char** argv)
+{
+	// Variables
+	const string   DATASET_PATH      =   argc > 1 ? argv[1] : "./Food_leftover_dataset/";
+	const string   RESULTS_PATH      =   argc > 2 ? argv[2] : "./benchmarks.json";
+	const int      REPETITIONS       =   argc > 3 ? max(1, stoi(argv[3])) : 5;   // At least one, the statistics need a time
+	const int      NUMBER_OF_TRAYS   =   8;
+	const int      SYNTHETIC_SIZE    =   600;
+	vector<Benchmark> results;
+	auto measure = [&results, REPETITIONS](const string& name, const string& input, int items, const function<void()>& setup, const function<void()>& run) -> void
+	{
+		Benchmark b{ name, input, items, {} };
+
+		// Warm up, then time each repetition without its setup
+		setup();
+		run();
+		for (int r = 0; r < REPETITIONS; r++)
+		{
+			setup();
+			auto start = chrono::steady_clock::now();
+			run();
+			auto end = chrono::steady_clock::now();
+			b.times.push_back(chrono::duration<double, milli>(end - start).count());
+		}
+
+		cout << name << " (" << input << "): " << *min_element(b.times.begin(), b.times.end()) << " ms" << endl;
+		results.push_back(b);
+	};
+
+	// Dataset inputs: food images, their detections, plates cutouts with ground truth labels
+	vector<cv::Mat> images;
+	vector<vector<cv::Vec3f>> plates, bowls;
+	vector<pair<bool, cv::Vec3f>> salads;
+	vector<cv::Mat> candidates;
+	vector<cv::Rect> candidate_boxes;
+	vector<int> candidate_images;
+	vector<cv::Mat> cutouts;
+	vector<cv::Vec3f> cutout_circles;
+	vector<vector<int>> cutout_labels;
+	vector<vector<tuple<cv::Mat, vector<pair<int, cv::Rect>>, cv::Mat, vector<pair<int, cv::Rect>>>>> metrics;
+	for (int i = 1; i <= NUMBER_OF_TRAYS; i++)
+	{	// For each tray [i]
+		const string tray = DATASET_PATH + "tray" + to_string(i) + "/";
+		cv::Mat image = cv::imread(tray + "food_image.jpg");
+		if (image.empty())
+			continue;
+
+		vector<cv::Vec3f> p, b;
+		BoundingBoxes::detectCircles(image, p, b);
+		pair<bool, cv::Vec3f> salad = !b.empty() ? make_pair(true, b[0]) : make_pair(false, cv::Vec3f());
+		cv::Mat candidate;
+		cv::Rect box;
+		if (BoundingBoxes::findBread(image, p, salad, candidate, box))
+		{
+			candidates.push_back(candidate);
+			candidate_boxes.push_back(box);
+			candidate_images.push_back(images.size());
+		}
+
+		// Label each plate with the ground truth boxes centered inside it
+		vector<pair<int, cv::Rect>> gt_boxes = utils::readBoxes(tray + "bounding_boxes/food_image_bounding_box.txt");
+		for (const auto& circle : p)
+		{
+			cutouts.push_back(utils::cutout(image, circle));
+			cutout_circles.push_back(circle);
+			cutout_labels.push_back(labelsInside(circle, gt_boxes));
+		}
+
+		// Fixed result set for Metrics: ground truth against itself
+		metrics.push_back({});
+		for (const auto& imgname : { "food_image", "leftover1", "leftover2", "leftover3" })
+		{
+			const string name = imgname;
+			cv::Mat mask = cv::imread(tray + "masks/" + name + (name == "food_image" ? "_mask" : "") + ".png", cv::IMREAD_GRAYSCALE);
+			vector<pair<int, cv::Rect>> boxes = utils::readBoxes(tray + "bounding_boxes/" + name + "_bounding_box.txt");
+			metrics.back().push_back(make_tuple(mask, boxes, mask, boxes));
+		}
+
+		images.push_back(image);
+		plates.push_back(p);
+		bowls.push_back(b);
+		salads.push_back(salad);
+	}
+	const string DATASET_INPUT = to_string(images.size()) + " dataset images";
+	const string CUTOUTS_INPUT = to_string(cutouts.size()) + " dataset plates";
+
+	// Synthetic inputs: a plate with food-like blobs, and a sparse binary mask
+	cv::RNG rng(42);
+	cv::Mat synthetic_plate(SYNTHETIC_SIZE, SYNTHETIC_SIZE, CV_8UC3, cv::Scalar(40, 40, 40));
+	cv::circle(synthetic_plate, cv::Point(SYNTHETIC_SIZE / 2, SYNTHETIC_SIZE / 2), SYNTHETIC_SIZE / 2 - 10, cv::Scalar(235, 235, 235), -1);
+	for (int k = 0; k < 12; k++)
+		cv::circle(synthetic_plate, cv::Point(rng.uniform(200, 400), rng.uniform(200, 400)), rng.uniform(20, 80), cv::Scalar(20, 60, 200), -1);
+	cv::Mat synthetic_mask = cv::Mat::zeros(SYNTHETIC_SIZE, SYNTHETIC_SIZE, CV_8UC1);
+	for (int k = 0; k < 40; k++)
+		cv::circle(synthetic_mask, cv::Point(rng.uniform(0, SYNTHETIC_SIZE), rng.uniform(0, SYNTHETIC_SIZE)), rng.uniform(5, 60), cv::Scalar(255), -1);
+	const string SYNTHETIC_INPUT = "synthetic " + to_string(SYNTHETIC_SIZE) + "x" + to_string(SYNTHETIC_SIZE);
+
+	// BoundingBoxes
+	measure("BoundingBoxes", DATASET_INPUT, images.size(), [] {}, [&] {
+		for (const auto& image : images) BoundingBoxes bb(image);
+	});
+	for (const double scale : { 0.5, 0.25 })
+	{	// Whole detection at a reduced processing scale, resizing included
+		const Resources resources(scale);
+		measure("BoundingBoxes", DATASET_INPUT + " at scale " + to_string(scale).substr(0, 4), images.size(), [] {}, [&] {
+			cv::Mat small;
+			for (const auto& image : images)
+			{
+				cv::resize(image, small, cv::Size(), scale, scale, cv::INTER_AREA);
+				BoundingBoxes bb(small, resources);
+			}
+		});
+	}
+	measure("BoundingBoxes::detectCircles", DATASET_INPUT, images.size(), [] {}, [&] {
+		vector<cv::Vec3f> p, b;
+		for (const auto& image : images) BoundingBoxes::detectCircles(image, p, b);
+	});
+	measure("BoundingBoxes::findBread", DATASET_INPUT, images.size(), [] {}, [&] {
+		cv::Mat candidate;
+		cv::Rect box;
+		for (int k = 0; k < images.size(); k++) BoundingBoxes::findBread(images[k], plates[k], salads[k], candidate, box);
+	});
+	measure("BoundingBoxes::grabBread", to_string(candidates.size()) + " dataset bread candidates", candidates.size(), [] {}, [&] {
+		for (int k = 0; k < candidates.size(); k++)
+		{
+			const int n = candidate_images[k];
+			BoundingBoxes::grabBread(images[n], plates[n], salads[n], candidates[k], candidate_boxes[k]);
+		}
+	});
+
+	// CLIP input
+	vector<float> tensor(3 * Classifier::INPUT_SIZE * Classifier::INPUT_SIZE);
+	measure("Classifier::preprocess", CUTOUTS_INPUT, cutouts.size(), [] {}, [&] {
+		for (const auto& cutout : cutouts) Classifier::preprocess(cutout, tensor.data());
+	});
+
+	// Segmentation
+	measure("Segmentation::correction", CUTOUTS_INPUT, cutouts.size(), [] {}, [&] {
+		cv::Mat out;
+		for (auto& cutout : cutouts) Segmentation::correction(cutout, out);
+	});
+	measure("Segmentation::correction", SYNTHETIC_INPUT, 1, [] {}, [&] {
+		cv::Mat out;
+		Segmentation::correction(synthetic_plate, out);
+	});
+	vector<cv::Mat> ranged, ranged_copies;   // Inputs of process, modified in place: copied before each repetition
+	for (int k = 0; k < cutouts.size(); k++)
+	{
+		cv::Mat corrected, r;
+		Segmentation::correction(cutouts[k], corrected);
+		for (const auto label : cutout_labels[k])
+		{
+			cv::inRange(corrected, Segmentation::c_ranges[label].first, Segmentation::c_ranges[label].second, r);
+			ranged.push_back(r.clone());
+		}
+	}
+	measure("Segmentation::process", to_string(ranged.size()) + " dataset label masks", ranged.size(), [&] {
+		ranged_copies.clear();
+		for (const auto& r : ranged) ranged_copies.push_back(r.clone());
+	}, [&] {
+		cv::Mat out;
+		for (auto& r : ranged_copies) Segmentation::process(r, out);
+	});
+	cv::Mat synthetic_copy;
+	measure("Segmentation::process", SYNTHETIC_INPUT, 1, [&] { synthetic_copy = synthetic_mask.clone(); }, [&] {
+		cv::Mat out;
+		Segmentation::process(synthetic_copy, out);
+	});
+
+	// Binary mask kernels, byte per pixel against bit-packed
+	measure("cv::medianBlur", to_string(ranged.size()) + " dataset label masks", ranged.size(), [] {}, [&] {
+		cv::Mat out;
+		for (const auto& r : ranged) cv::medianBlur(r, out, Segmentation::BLUR_STRENGTH);
+	});
+	measure("BitMask::majority", to_string(ranged.size()) + " dataset label masks", ranged.size(), [] {}, [&] {
+		for (const auto& r : ranged) BitMask(r).majority(Segmentation::BLUR_STRENGTH).toMat();
+	});
+	vector<BitMask> packed;
+	size_t nonzero = 0;   // Kept alive across the measures so that the counts are not optimized away
+	for (const auto& r : ranged) packed.push_back(BitMask(r));
+	measure("cv::countNonZero", to_string(ranged.size()) + " dataset label masks", ranged.size(), [] {}, [&] {
+		for (const auto& r : ranged) nonzero += cv::countNonZero(r);
+	});
+	measure("BitMask::count", to_string(ranged.size()) + " dataset label masks", ranged.size(), [] {}, [&] {
+		for (const auto& p : packed) nonzero += p.count();
+	});
+	const cv::Mat& close_kernel = Resources::shared().segmentation_first_close;
+	measure("cv::morphologyEx close", to_string(ranged.size()) + " dataset label masks", ranged.size(), [] {}, [&] {
+		cv::Mat out;
+		for (const auto& r : ranged) cv::morphologyEx(r, out, cv::MORPH_CLOSE, close_kernel);
+	});
+	measure("Morphology close", to_string(ranged.size()) + " dataset label masks", ranged.size(), [] {}, [&] {
+		for (const auto& p : packed) Morphology(p, { { Morphology::DILATE, close_kernel }, { Morphology::ERODE, close_kernel } });
+	});
+	measure("Segmentation", CUTOUTS_INPUT, cutouts.size(), [] {}, [&] {
+		for (int k = 0; k < cutouts.size(); k++) Segmentation seg(cutouts[k], cutout_labels[k]);
+	});
+
+	// Check: the packed chains of Segmentation::process and Tray::process (majority, tiles, streamed morphology) give the same pixels
+	// as the whole-mask OpenCV chains they replace, on the dataset label masks and on synthetic masks touching the borders
+	auto filter_areas = [](const cv::Mat& input, cv::Mat& output, unsigned int threshold) -> void
+	{
+		vector<vector<cv::Point>> c;
+		cv::findContours(input.clone(), c, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+		for (int i = 0; i < c.size(); i++)
+			if (cv::contourArea(c[i]) > threshold)
+				cv::drawContours(output, c, i, 255, -1);
+	};
+	auto fill_holes = [](cv::Mat& input) -> void
+	{
+		cv::Mat ff = input.clone();
+		cv::floodFill(ff, cv::Point(0, 0), cv::Scalar(255));
+		cv::Mat inversed_ff;
+		cv::bitwise_not(ff, inversed_ff);
+		input = (input | inversed_ff);
+	};
+	auto opencv_chain = [&](const cv::Mat& mask, int blur, const cv::Mat& first_close, unsigned int area, const cv::Mat& dilate, const cv::Mat& second_close) -> cv::Mat
+	{
+		cv::Mat in, out = cv::Mat::zeros(mask.size(), CV_8UC1);
+		cv::medianBlur(mask, in, blur);
+		cv::morphologyEx(in, in, cv::MORPH_CLOSE, first_close);
+		filter_areas(in, out, area);
+		cv::dilate(out, out, dilate);
+		cv::morphologyEx(out, out, cv::MORPH_CLOSE, second_close);
+		fill_holes(out);
+		return out;
+	};
+	vector<cv::Mat> chain_inputs = ranged;
+	for (const int side : { SYNTHETIC_SIZE, SYNTHETIC_SIZE / 3 })
+	{	// Blobs centered on the borders and corners, a frame, and a full mask
+		cv::Mat border = cv::Mat::zeros(side, side, CV_8UC1);
+		for (int k = 0; k < 12; k++)
+		{
+			const int along = rng.uniform(0, side), edge = rng.uniform(0, 4);
+			const cv::Point center = edge == 0 ? cv::Point(along, 0) : edge == 1 ? cv::Point(along, side - 1) : edge == 2 ? cv::Point(0, along) : cv::Point(side - 1, along);
+			cv::circle(border, center, rng.uniform(side / 20 + 1, side / 4 + 2), cv::Scalar(255), -1);
+		}
+		cv::circle(border, cv::Point(0, 0), side / 5, cv::Scalar(255), -1);
+		cv::circle(border, cv::Point(side - 1, side - 1), side / 5, cv::Scalar(255), -1);
+		chain_inputs.push_back(border);
+		cv::Mat frame = cv::Mat::zeros(side, side, CV_8UC1);
+		cv::rectangle(frame, cv::Rect(0, 0, side, side), cv::Scalar(255), side / 10);
+		chain_inputs.push_back(frame);
+		chain_inputs.push_back(cv::Mat(side, side, CV_8UC1, cv::Scalar(255)));
+	}
+	chain_inputs.push_back(synthetic_mask);
+	int chain_mismatches = 0;
+	for (int k = 0; k < chain_inputs.size(); k++)
+	{
+		const Resources& r = Resources::shared();
+		cv::Mat in = chain_inputs[k].clone(), segmentation;
+		Segmentation::process(in, segmentation, r);
+		const cv::Mat segmentation_reference = opencv_chain(chain_inputs[k], r.segmentation_blur_strength, r.segmentation_first_close, r.segmentation_area_threshold, r.segmentation_dilate, r.segmentation_second_close);
+		const int segmentation_diff = cv::countNonZero(segmentation != segmentation_reference);
+
+		in = chain_inputs[k].clone();
+		const cv::Mat tray = Tray::process(in, r);
+		const cv::Mat tray_reference = opencv_chain(chain_inputs[k], r.salad_blur_strength, r.salad_initial_close, r.salad_area_threshold, r.salad_kernel, r.salad_kernel);
+		const int tray_diff = cv::countNonZero(tray != tray_reference);
+
+		if (segmentation_diff || tray_diff)
+		{
+			cerr << "Morphology mismatch on " << (k < ranged.size() ? "dataset label mask " : "synthetic mask ") << k << ": "
+				<< segmentation_diff << " pixels in Segmentation::process, " << tray_diff << " in Tray::process" << endl;
+			chain_mismatches++;
+		}
+	}
+	cout << "Morphology check: " << chain_inputs.size() - chain_mismatches << "/" << chain_inputs.size() << " masks identical to the OpenCV chains" << endl;
+
+	// Tray mask pasting
+	vector<cv::Mat> segments;
+	for (int k = 0; k < cutouts.size(); k++)
+		segments.push_back(Segmentation(cutouts[k], cutout_labels[k]).getSegments());
+	measure("utils::paste", CUTOUTS_INPUT, cutouts.size(), [] {}, [&] {
+		cv::Mat tray_mask = cv::Mat::zeros(images.empty() ? cv::Size() : images[0].size(), CV_8UC1);
+		for (int k = 0; k < segments.size(); k++) utils::paste(tray_mask, segments[k], cutout_circles[k]);
+	});
+
+	// Metrics (computation only, no reports written)
+	measure("Metrics", to_string(metrics.size()) + " dataset trays (ground truth)", metrics.size(), [] {}, [&] {
+		Metrics m(metrics, "");
+	});
+
+	// Check: the reports merged from two shards, saved and loaded as by --shard and --merge, are byte-identical to the ones of a full run
+	auto read_file = [](const string& path) -> string
+	{
+		ifstream in(path, ios::binary);
+		return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	};
+	const filesystem::path merge_path = filesystem::temp_directory_path() / "food_bench";   // Benchmark only, removed after the check
+	filesystem::create_directories(merge_path / "full");
+	filesystem::create_directories(merge_path / "merged");
+	Metrics full(metrics, (merge_path / "full/").string());
+	vector<Metrics::Partial> shards[2];
+	for (int t = 0; t < metrics.size(); t++)
+		shards[t % 2].push_back(Metrics::partial(metrics[t], t + 1));
+	vector<Metrics::Partial> merged;
+	for (int k = 1; k >= 0; k--)
+	{	// Shards saved and merged in reverse order, as --merge may list them
+		const string path = (merge_path / ("partial" + to_string(k + 1) + "of2.yml")).string();
+		Metrics::save(shards[k], path);
+		vector<Metrics::Partial> loaded = Metrics::load(path);
+		merged.insert(merged.end(), loaded.begin(), loaded.end());
+	}
+	Metrics merge(merged, (merge_path / "merged/").string());
+	int merge_mismatches = 0;
+	for (const auto& report : { "Food_leftover.txt", "metrics_results.txt" })
+		if (read_file((merge_path / "full" / report).string()) != read_file((merge_path / "merged" / report).string()))
+		{
+			cerr << "Merge mismatch: " << report << " of the merged shards differs from the full run" << endl;
+			merge_mismatches++;
+		}
+	filesystem::remove_all(merge_path);
+	cout << "Merge check: " << (merge_mismatches ? "reports differ" : "reports identical") << " for 2 shards of " << metrics.size() << " trays" << endl;
+
+	// Write results
+	ofstream file(RESULTS_PATH);
+	file << "{" << endl;
+	file << "  \"opencv_version\": \"" << CV_VERSION << "\"," << endl;
+	file << "  \"opencv_threads\": " << cv::getNumThreads() << "," << endl;
+	file << "  \"repetitions\": " << REPETITIONS << "," << endl;
+	file << "  \"benchmarks\": [" << endl;
+	for (int k = 0; k < results.size(); k++)
+	{
+		vector<double> t = results[k].times;
+		sort(t.begin(), t.end());
+		const double mean = accumulate(t.begin(), t.end(), 0.0) / t.size();
+		const double median = t.size() % 2 ? t[t.size() / 2] : (t[t.size() / 2 - 1] + t[t.size() / 2]) / 2;
+
+		file << "    { \"name\": \"" << results[k].name << "\", \"input\": \"" << results[k].input << "\", \"items\": " << results[k].items
+			<< ", \"min_ms\": " << t.front() << ", \"median_ms\": " << median << ", \"mean_ms\": " << mean << ", \"max_ms\": " << t.back() << " }"
+			<< (k < results.size() - 1 ? "," : "") << endl;
+	}
+	file << "  ]" << endl;
+	file << "}" << endl;
+
+	cout << "Results written to " << RESULTS_PATH << endl;
+
+	// A failed check fails the run
+	return chain_mismatches > 0 || merge_mismatches > 0 ? 1 : 0;
+}
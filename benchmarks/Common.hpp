@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief Labels of the ground truth boxes centered inside a plate, standing in for CLIP when benchmarking.
+ * @param circle The plate circle.
+ * @param boxes The ground truth labeled boxes of the image.
+ * @return The labels of the plate.
+ */
+inline std::vector<int> labelsInside(const cv::Vec3f& circle, const std::vector<std::pair<int, cv::Rect>>& boxes)
+{
+	std::vector<int> labels;
+	for (const auto& box : boxes)
+	{
+		const double x = box.second.x + box.second.width / 2.0;
+		const double y = box.second.y + box.second.height / 2.0;
+		if (box.first < 12 && std::hypot(x - circle[0], y - circle[1]) < circle[2])
+			labels.push_back(box.first);
+	}
+	return labels;
+}
@@ -0,0 +1,144 @@
+// Synthetic tray generator: renders trays with plates, a salad bowl and bread, the food painted in the colours of the
+// Segmentation classes, together with ground truth masks and bounding boxes in the layout of Food_leftover_dataset.
+//
+// Usage: generator [output path] [number of trays] [seed]
+
+#include "Segmentation.hpp"
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+
+struct Food
+{
+	int label;          // Class of the food
+	cv::Point center;   // Center of the food blob
+	cv::Size axes;      // Half axes of the food blob, before eating
+	double angle;       // Rotation of the food blob
+};
+
+int main(int argc, char** argv)
+{
+	// Variables
+	const string   OUTPUT_PATH       =   argc > 1 ? argv[1] : "./Synthetic_dataset/";
+	const int      NUMBER_OF_TRAYS   =   argc > 2 ? stoi(argv[2]) : 100;
+	const int      SEED              =   argc > 3 ? stoi(argv[3]) : 42;
+	const cv::Size IMAGE_SIZE        =   cv::Size(1280, 960);                                       // Same resolution as the dataset
+	const vector<string> IMAGE_NAMES =   { "food_image", "leftover1", "leftover2", "leftover3" };
+	const vector<double> LEFTOVERS   =   { 1.0, 0.6, 0.35, 0.1 };                                  // Fraction of the food axes left in each image
+	cv::RNG rng(SEED);
+	auto colour = [](int label) -> cv::Scalar
+	{	// Invert the gamma correction of Segmentation on the middle of the class range
+		const auto& range = Segmentation::c_ranges[label];
+		cv::Scalar c;
+		for (int k = 0; k < 3; k++)
+			c[k] = 255.0 * pow((range.first[k] + range.second[k]) / 2.0 / 255.0, 1.0 / Segmentation::GAMMA);
+		return c;
+	};
+	auto draw_food = [&rng](cv::Mat& image, cv::Mat& mask, const Food& food, double left, const cv::Scalar& c) -> void
+	{
+		if (left <= 0)
+			return;
+
+		// Irregular blob: an ellipse with a few bumps on its border
+		cv::Size axes(cvRound(food.axes.width * left), cvRound(food.axes.height * left));
+		cv::Mat blob = cv::Mat::zeros(image.size(), CV_8UC1);
+		cv::ellipse(blob, food.center, axes, food.angle, 0, 360, cv::Scalar(255), -1);
+		for (int k = 0; k < 6; k++)
+		{
+			const double t = rng.uniform(0.0, 2 * CV_PI);
+			cv::Point bump(food.center.x + cvRound(cos(t) * axes.width * 0.8), food.center.y + cvRound(sin(t) * axes.height * 0.8));
+			cv::circle(blob, bump, cvRound(min(axes.width, axes.height) * 0.35), cv::Scalar(255), -1);
+		}
+
+		// Textured colour
+		cv::Mat texture(image.size(), CV_8UC3);
+		cv::randn(texture, c, cv::Scalar(8, 8, 8));
+		texture.copyTo(image, blob);
+		mask.setTo(cv::Scalar(food.label), blob);
+	};
+
+	for (int i = 1; i <= NUMBER_OF_TRAYS; i++)
+	{	// For each tray [i]
+		const string tray = OUTPUT_PATH + "tray" + to_string(i) + "/";
+		filesystem::create_directories(tray + "masks/");
+		filesystem::create_directories(tray + "bounding_boxes/");
+
+		// Layout: first course plate, second course plate with a side dish, optional salad bowl and bread
+		const cv::Vec3f first_plate(330 + rng.uniform(-15, 15), 630 + rng.uniform(-15, 15), rng.uniform(250, 290));
+		const cv::Vec3f second_plate(920 + rng.uniform(-15, 15), 330 + rng.uniform(-15, 15), rng.uniform(250, 290));
+		const cv::Vec3f bowl(1090 + rng.uniform(-10, 10), 790 + rng.uniform(-10, 10), rng.uniform(175, 190));
+		const bool has_salad = rng.uniform(0.0, 1.0) < 0.6;
+		const bool has_bread = rng.uniform(0.0, 1.0) < 0.5;
+
+		vector<Food> foods;
+		const int first_course = rng.uniform(1, 6);    // 1..5
+		const int second_course = rng.uniform(6, 10);  // 6..9
+		const int side_dish = rng.uniform(10, 12);     // 10..11
+		const int r1 = cvRound(first_plate[2]), r2 = cvRound(second_plate[2]);
+		foods.push_back({ first_course, cv::Point(cvRound(first_plate[0]), cvRound(first_plate[1])), cv::Size(cvRound(r1 * 0.6), cvRound(r1 * 0.5)), rng.uniform(0.0, 180.0) });
+		foods.push_back({ second_course, cv::Point(cvRound(second_plate[0]) - r2 / 3, cvRound(second_plate[1])), cv::Size(cvRound(r2 * 0.3), cvRound(r2 * 0.45)), rng.uniform(-20.0, 20.0) });
+		foods.push_back({ side_dish, cv::Point(cvRound(second_plate[0]) + r2 / 3, cvRound(second_plate[1])), cv::Size(cvRound(r2 * 0.28), cvRound(r2 * 0.4)), rng.uniform(-20.0, 20.0) });
+		if (has_salad)
+			foods.push_back({ 12, cv::Point(cvRound(bowl[0]), cvRound(bowl[1])), cv::Size(cvRound(bowl[2] * 0.7), cvRound(bowl[2] * 0.65)), rng.uniform(0.0, 180.0) });
+		if (has_bread)
+			foods.push_back({ 13, cv::Point(260 + rng.uniform(-20, 20), 170 + rng.uniform(-20, 20)), cv::Size(rng.uniform(90, 120), rng.uniform(65, 85)), rng.uniform(-30.0, 30.0) });
+
+		// Food eaten randomly between the images, but never more food in later images
+		vector<double> eaten(foods.size());
+		for (auto& e : eaten) e = rng.uniform(0.5, 1.5);
+
+		for (int n = 0; n < IMAGE_NAMES.size(); n++)
+		{	// For each image [n] of tray [i]
+			cv::Mat image(IMAGE_SIZE, CV_8UC3);
+			cv::randn(image, cv::Scalar(150, 165, 175), cv::Scalar(6, 6, 6));   // Tray
+			cv::Mat mask = cv::Mat::zeros(IMAGE_SIZE, CV_8UC1);
+
+			// Plates and bowl: white discs with a darker rim, for the Hough transform
+			for (const auto& circle : { first_plate, second_plate })
+			{
+				cv::circle(image, cv::Point(cvRound(circle[0]), cvRound(circle[1])), cvRound(circle[2]), cv::Scalar(236, 236, 232), -1, cv::LINE_AA);
+				cv::circle(image, cv::Point(cvRound(circle[0]), cvRound(circle[1])), cvRound(circle[2]) - 6, cv::Scalar(205, 205, 200), 6, cv::LINE_AA);
+			}
+			if (has_salad)
+			{
+				cv::circle(image, cv::Point(cvRound(bowl[0]), cvRound(bowl[1])), cvRound(bowl[2]), cv::Scalar(230, 230, 230), -1, cv::LINE_AA);
+				cv::circle(image, cv::Point(cvRound(bowl[0]), cvRound(bowl[1])), cvRound(bowl[2]) - 5, cv::Scalar(200, 200, 200), 5, cv::LINE_AA);
+			}
+
+			// Food
+			for (int f = 0; f < foods.size(); f++)
+			{
+				const double left = foods[f].label == 13 && n > 0 ? 0 : pow(LEFTOVERS[n], eaten[f]);   // Bread is always taken away
+				const cv::Scalar c = foods[f].label == 12 ? cv::Scalar(50, 170, 70) : foods[f].label == 13 ? cv::Scalar(80, 150, 205) : colour(foods[f].label);
+				draw_food(image, mask, foods[f], left, c);
+			}
+
+			// Ground truth boxes, from the mask
+			ofstream file(tray + "bounding_boxes/" + IMAGE_NAMES[n] + "_bounding_box.txt");
+			for (const auto& food : foods)
+			{
+				cv::Mat points;
+				cv::findNonZero(mask == food.label, points);
+				if (points.empty())
+					continue;
+				cv::Rect box = cv::boundingRect(points);
+				file << "ID: " << food.label << "; [" << box.x << ", " << box.y << ", " << box.width << ", " << box.height << "]" << endl;
+			}
+
+			cv::imwrite(tray + IMAGE_NAMES[n] + ".jpg", image);
+			cv::imwrite(tray + "masks/" + IMAGE_NAMES[n] + (n == 0 ? "_mask" : "") + ".png", mask);
+		}
+	}
+
+	cout << NUMBER_OF_TRAYS << " trays written to " << OUTPUT_PATH << endl;
+
+	return 0;
+}
@@ -0,0 +1,171 @@
+// End-to-end load test: pushes the images of a dataset (e.g. written by the generator) through the whole pipeline,
+// BoundingBoxes -> Segmentation -> Tray through one Context per thread, and reports throughput, latency percentiles and memory.
+// The plates are labeled with the ground truth instead of CLIP, so that only the native pipeline is measured.
+//
+// Usage: loadtest [dataset path] [number of images] [threads] [output file] [cores] [pin] [memory budget MiB] [deadline ms]
+
+#include "Context.hpp"
+#include "Utils.hpp"
+#include "Common.hpp"
+#include "ThreadBudget.hpp"
+#include "Governor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+	// Variables
+	const string           DATASET_PATH       =   argc > 1 ? argv[1] : "./Synthetic_dataset/";
+	const int              NUMBER_OF_IMAGES   =   argc > 2 ? stoi(argv[2]) : 10000;
+	const int              THREADS            =   argc > 3 ? stoi(argv[3]) : max(1u, thread::hardware_concurrency());
+	const string           RESULTS_PATH       =   argc > 4 ? argv[4] : "./loadtest.json";
+	const int              CORES              =   argc > 5 ? stoi(argv[5]) : 0;   // All the hardware threads if 0
+	const bool             PIN                =   argc > 6 && string(argv[6]) == "pin";
+	const size_t           MEMORY_BUDGET      =   argc > 7 ? stoull(argv[7]) << 20 : 0;   // Unlimited if 0
+	const int              DEADLINE           =   argc > 8 ? stoi(argv[8]) : 0;           // Unlimited if 0
+	const vector<string>   IMAGE_NAMES        =   { "food_image", "leftover1", "leftover2", "leftover3" };
+	auto percentile = [](const vector<double>& sorted, double p) -> double
+	{
+		if (sorted.empty())
+			return 0;
+		const size_t k = (size_t)max(0.0, ceil(p / 100.0 * sorted.size()) - 1);   // Nearest rank
+		return sorted[min(k, sorted.size() - 1)];
+	};
+
+	// Inputs: every image of every tray, cycled until NUMBER_OF_IMAGES
+	vector<pair<string, string>> inputs;   // <image path, ground truth boxes path>
+	for (const auto& entry : filesystem::directory_iterator(DATASET_PATH))
+	{
+		if (!entry.is_directory() || entry.path().filename().string().rfind("tray", 0) != 0)
+			continue;
+		const string tray = entry.path().string() + "/";
+		for (const auto& imgname : IMAGE_NAMES)
+			if (filesystem::exists(tray + imgname + ".jpg"))
+				inputs.push_back(make_pair(tray + imgname + ".jpg", tray + "bounding_boxes/" + imgname + "_bounding_box.txt"));
+	}
+	if (inputs.empty())
+	{
+		cerr << "No trays found in " << DATASET_PATH << endl;
+		return 1;
+	}
+	sort(inputs.begin(), inputs.end());
+
+	// Thread budget: the OpenCV pool is sized to the share of one worker, no interpreters
+	ThreadBudget budget(CORES, THREADS, 0, PIN);
+	budget.apply();
+	cout << budget.report() << endl;
+
+	// Admission: the images in flight are bounded by the memory budget, a worker waits before reading the next one
+	Governor governor(MEMORY_BUDGET);
+
+	// Workers: each one takes the next image until all of them are processed
+	atomic<int> next(0);
+	atomic<int> failures(0);
+	vector<vector<double>> latencies(THREADS);   // Milliseconds per image, admission wait included, for each worker
+	vector<vector<double>> waits(THREADS);       // Milliseconds per image waiting for admission, for each worker
+	vector<map<string, int>> skipped(THREADS);   // Images that skipped each refinement, for each worker
+	auto worker = [&](int w) -> void
+	{
+		budget.pinWorker(w);
+		Context context(false, 1.0, chrono::milliseconds(DEADLINE));   // Labels come from the ground truth, no classifier session needed
+		for (int n = next++; n < NUMBER_OF_IMAGES; n = next++)
+		{
+			const auto& input = inputs[n % inputs.size()];
+			auto start = chrono::steady_clock::now();
+			Governor::Ticket ticket = governor.admit();
+			waits[w].push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+			cv::Mat image = cv::imread(input.first);
+			if (image.empty())
+			{
+				failures++;
+				continue;
+			}
+			ticket.update(image.size());
+			vector<pair<int, cv::Rect>> gt_boxes = utils::readBoxes(input.second);
+			const Context::Result result = context.processLabeled(image, [&](const cv::Vec3f& circle) { return labelsInside(circle, gt_boxes); }, &ticket);
+			for (const auto& step : result.skipped)
+				skipped[w][step]++;
+
+			auto end = chrono::steady_clock::now();
+			latencies[w].push_back(chrono::duration<double, milli>(end - start).count());
+		}
+	};
+
+	const size_t rss_before = utils::residentMemory();
+	auto start = chrono::steady_clock::now();
+	vector<thread> workers;
+	for (int w = 0; w < THREADS; w++)
+		workers.emplace_back(worker, w);
+	for (auto& t : workers)
+		t.join();
+	auto end = chrono::steady_clock::now();
+
+	// Results
+	vector<double> all;
+	for (const auto& l : latencies)
+		all.insert(all.end(), l.begin(), l.end());
+	sort(all.begin(), all.end());
+	vector<double> all_waits;
+	for (const auto& w : waits)
+		all_waits.insert(all_waits.end(), w.begin(), w.end());
+	sort(all_waits.begin(), all_waits.end());
+	const double wait_p50 = percentile(all_waits, 50), wait_p95 = percentile(all_waits, 95), wait_max = all_waits.empty() ? 0 : all_waits.back();
+	map<string, int> skipped_steps;
+	for (const auto& s : skipped)
+		for (const auto& [step, count] : s)
+			skipped_steps[step] += count;
+	const double seconds = chrono::duration<double>(end - start).count();
+	const double throughput = all.size() / seconds;
+	const double p50 = percentile(all, 50), p95 = percentile(all, 95), p99 = percentile(all, 99);
+	const size_t rss_peak = utils::residentMemory(true);
+
+	cout << "Images: " << all.size() << " (" << failures << " failed) from " << inputs.size() << " distinct, " << THREADS << " threads" << endl;
+	cout << "Throughput: " << throughput << " images/s" << endl;
+	cout << "Latency: p50 " << p50 << " ms, p95 " << p95 << " ms, p99 " << p99 << " ms, max " << (all.empty() ? 0 : all.back()) << " ms" << endl;
+	cout << "Memory: " << rss_before / (1 << 20) << " MiB before, " << rss_peak / (1 << 20) << " MiB peak" << endl;
+	if (DEADLINE > 0)
+	{
+		cout << "Deadline " << DEADLINE << " ms, skipped:";
+		for (const auto& [step, count] : skipped_steps)
+			cout << " " << step << " " << count;
+		cout << (skipped_steps.empty() ? " none" : "") << endl;
+	}
+	if (MEMORY_BUDGET > 0) cout << "Admission: " << governor.getWaits() << " of " << governor.getAdmitted() << " images waited (p50 " << wait_p50 << " ms, p95 " << wait_p95 << " ms, max " << wait_max << " ms), "
+		<< governor.getPeak() / (1 << 20) << " MiB peak reserved of " << MEMORY_BUDGET / (1 << 20) << " MiB" << endl;
+
+	ofstream file(RESULTS_PATH);
+	file << "{" << endl;
+	file << "  \"images\": " << all.size() << "," << endl;
+	file << "  \"failures\": " << failures << "," << endl;
+	file << "  \"distinct_images\": " << inputs.size() << "," << endl;
+	file << "  \"threads\": " << THREADS << "," << endl;
+	file << "  \"cores\": " << budget.getCores() << "," << endl;
+	file << "  \"seconds\": " << seconds << "," << endl;
+	file << "  \"throughput\": " << throughput << "," << endl;
+	file << "  \"latency_ms\": { \"p50\": " << p50 << ", \"p95\": " << p95 << ", \"p99\": " << p99 << ", \"max\": " << (all.empty() ? 0 : all.back()) << " }," << endl;
+	file << "  \"rss_bytes\": { \"before\": " << rss_before << ", \"peak\": " << rss_peak << " }," << endl;
+	file << "  \"admission\": { \"budget_bytes\": " << MEMORY_BUDGET << ", \"waits\": " << governor.getWaits() << ", \"peak_reserved_bytes\": " << governor.getPeak()
+		<< ", \"wait_ms\": { \"p50\": " << wait_p50 << ", \"p95\": " << wait_p95 << ", \"max\": " << wait_max << " } }," << endl;
+	file << "  \"deadline\": { \"budget_ms\": " << DEADLINE << ", \"skipped\": {";
+	for (auto it = skipped_steps.begin(); it != skipped_steps.end(); ++it)
+		file << (it == skipped_steps.begin() ? " " : ", ") << "\"" << it->first << "\": " << it->second;
+	file << " } }" << endl;
+	file << "}" << endl;
+
+	return 0;
+}
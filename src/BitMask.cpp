@@ -0,0 +1,189 @@
+#include "BitMask.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#define DEBUG false
+
+BitMask::BitMask(int r, int c)
+	: rows(r), cols(c), words((c + 63) / 64), data(size_t(r) * ((c + 63) / 64), 0)
+{
+}
+
+BitMask::BitMask(const cv::Mat& mask)
+	: BitMask(mask.rows, mask.cols)
+{
+	CV_Assert(mask.type() == CV_8UC1);
+
+	for (int y = 0; y < rows; y++)
+	{
+		const uchar* p = mask.ptr<uchar>(y);
+		uint64_t* row = &data[size_t(y) * words];
+		int x = 0;
+		for (; x + 8 <= cols; x += 8)
+		{	// 8 pixels at once: high bit of each non zero byte, then gathered into 8 consecutive bits
+			uint64_t v;
+			std::memcpy(&v, p + x, 8);
+			v = (((v & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | v) & 0x8080808080808080ULL;
+			row[x / 64] |= (((v >> 7) * 0x0102040810204080ULL) >> 56) << (x % 64);
+		}
+		for (; x < cols; x++)
+			if (p[x]) row[x / 64] |= uint64_t(1) << (x % 64);
+	}
+}
+
+cv::Mat BitMask::toMat(uchar value) const
+{
+	cv::Mat mask(rows, cols, CV_8UC1);
+	for (int y = 0; y < rows; y++)
+	{
+		uchar* p = mask.ptr<uchar>(y);
+		const uint64_t* row = &data[size_t(y) * words];
+		for (int x = 0; x < cols; x++)
+			p[x] = ((row[x / 64] >> (x % 64)) & 1) ? value : 0;
+	}
+	return mask;
+}
+
+void BitMask::set(int y, int x, bool v)
+{
+	uint64_t& word = data[size_t(y) * words + x / 64];
+	const uint64_t bit = uint64_t(1) << (x % 64);
+	word = v ? word | bit : word & ~bit;
+}
+
+size_t BitMask::count() const
+{
+	size_t n = 0;
+	for (const auto word : data)
+		n += std::popcount(word);
+	return n;
+}
+
+bool BitMask::none() const
+{
+	return std::all_of(data.begin(), data.end(), [](uint64_t word) { return word == 0; });
+}
+
+BitMask& BitMask::operator&=(const BitMask& other)
+{
+	CV_Assert(rows == other.rows && cols == other.cols);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] &= other.data[i];
+	return *this;
+}
+
+BitMask& BitMask::operator|=(const BitMask& other)
+{
+	CV_Assert(rows == other.rows && cols == other.cols);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] |= other.data[i];
+	return *this;
+}
+
+BitMask BitMask::operator~() const
+{
+	BitMask m = *this;
+	for (auto& word : m.data)
+		word = ~word;
+	m.clearPadding();
+	return m;
+}
+
+BitMask BitMask::majority(int size) const
+{
+	CV_Assert(size % 2 == 1 && size < 64);
+	const int radius = size / 2;
+	const unsigned int threshold = size * size / 2 + 1;                  // Set if at least half of the window is set
+	const int h_planes = std::bit_width(unsigned(size));                  // Bits of the horizontal counts
+	const int v_planes = std::bit_width(unsigned(size * size));           // Bits of the window counts
+	const int padded_words = (cols + 2 * radius + 63) / 64 + 1;           // Words of a row padded by radius on both sides, plus a zero word
+
+	BitMask output(rows, cols);
+	if (rows == 0 || cols == 0) return output;
+
+	// Horizontal counts of each row, bit-sliced: h_sums[(y * h_planes + plane) * words + w]
+	std::vector<uint64_t> h_sums(size_t(rows) * h_planes * words, 0);
+	std::vector<uint64_t> padded(padded_words);
+	for (int y = 0; y < rows; y++)
+	{
+		// Shift the row by radius and replicate the border columns in the padding
+		const uint64_t* row = &data[size_t(y) * words];
+		std::fill(padded.begin(), padded.end(), 0);
+		for (int w = 0; w < words; w++)
+		{
+			padded[w] |= radius ? row[w] << radius : row[w];
+			if (radius) padded[w + 1] |= row[w] >> (64 - radius);
+		}
+		for (int x = 0; x < radius; x++)
+		{
+			if (get(y, 0)) padded[x / 64] |= uint64_t(1) << (x % 64);
+			const int right = cols + radius + x;
+			if (get(y, cols - 1)) padded[right / 64] |= uint64_t(1) << (right % 64);
+		}
+
+		// Output column x sees the padded columns x .. x + 2 * radius
+		uint64_t* sum = &h_sums[size_t(y) * h_planes * words];
+		for (int w = 0; w < words; w++)
+		{
+			for (int k = 0; k < size; k++)
+			{
+				uint64_t carry = k ? (padded[w] >> k) | (padded[w + 1] << (64 - k)) : padded[w];
+				for (int plane = 0; plane < h_planes && carry; plane++)
+				{	// Bit-sliced increment
+					const uint64_t next = sum[plane * words + w] & carry;
+					sum[plane * words + w] ^= carry;
+					carry = next;
+				}
+			}
+		}
+	}
+
+	// Vertical sums of the horizontal counts, compared with the threshold
+	std::vector<uint64_t> acc(v_planes);
+	for (int y = 0; y < rows; y++)
+	{
+		uint64_t* out = &output.data[size_t(y) * words];
+		for (int w = 0; w < words; w++)
+		{
+			std::fill(acc.begin(), acc.end(), 0);
+			for (int dy = -radius; dy <= radius; dy++)
+			{	// Bit-sliced ripple carry addition, replicating the border rows
+				const uint64_t* sum = &h_sums[size_t(std::clamp(y + dy, 0, rows - 1)) * h_planes * words];
+				uint64_t carry = 0;
+				for (int plane = 0; plane < v_planes; plane++)
+				{
+					const uint64_t a = acc[plane];
+					const uint64_t b = plane < h_planes ? sum[plane * words + w] : 0;
+					acc[plane] = a ^ b ^ carry;
+					carry = (a & b) | (carry & (a ^ b));
+				}
+			}
+
+			// acc >= threshold, from the most significant bit
+			uint64_t greater = 0, equal = ~uint64_t(0);
+			for (int plane = v_planes - 1; plane >= 0; plane--)
+			{
+				if ((threshold >> plane) & 1) equal &= acc[plane];
+				else
+				{
+					greater |= equal & acc[plane];
+					equal &= ~acc[plane];
+				}
+			}
+			out[w] = greater | equal;
+		}
+	}
+	output.clearPadding();
+
+	return output;
+}
+
+void BitMask::clearPadding()
+{
+	if (cols % 64 == 0) return;
+	const uint64_t keep = (uint64_t(1) << (cols % 64)) - 1;
+	for (int y = 0; y < rows; y++)
+		data[size_t(y) * words + words - 1] &= keep;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+class BitMask
+{
+public:
+	/**
+	 * @brief Construct a new empty BitMask object, one bit per pixel packed in 64-bit words per row.
+	 * @param r The number of rows.
+	 * @param c The number of columns.
+	 */
+	BitMask(int r = 0, int c = 0);
+	/**
+	 * @brief Construct a new BitMask object from a binary mask, set where it is non zero.
+	 * @param mask The CV_8UC1 mask.
+	 */
+	explicit BitMask(const cv::Mat& mask);
+
+	/**
+	 * @brief Convert back to a CV_8UC1 mask.
+	 * @param value The value of the set pixels.
+	 * @return The mask, value where set and 0 elsewhere.
+	 */
+	cv::Mat toMat(uchar value = 255) const;
+
+	int getRows() const { return rows; }
+	int getCols() const { return cols; }
+	int getWords() const { return words; }
+	const uint64_t* row(int y) const { return &data[size_t(y) * words]; }
+	uint64_t* row(int y) { return &data[size_t(y) * words]; }
+	bool get(int y, int x) const { return (data[y * words + x / 64] >> (x % 64)) & 1; }
+	void set(int y, int x, bool v);
+
+	/**
+	 * @brief Number of set pixels, by popcount of the words.
+	 * @return The count.
+	 */
+	size_t count() const;
+	/**
+	 * @brief True if no pixel is set, stopping at the first non zero word.
+	 */
+	bool none() const;
+
+	BitMask& operator&=(const BitMask& other);
+	BitMask& operator|=(const BitMask& other);
+	BitMask operator&(const BitMask& other) const { BitMask m = *this; return m &= other; }
+	BitMask operator|(const BitMask& other) const { BitMask m = *this; return m |= other; }
+	BitMask operator~() const;
+
+	/**
+	 * @brief Majority filter, equivalent to cv::medianBlur on a binary mask, with replicated borders.
+	 * The counts of the window are bit-sliced: each word holds one bit of the count of 64 pixels, so that 64 pixels are filtered at once.
+	 * @param size The odd window size.
+	 * @return The filtered mask.
+	 */
+	BitMask majority(int size) const;
+
+private:
+	int rows, cols;                // Size of the mask
+	int words;                     // Words per row
+	std::vector<uint64_t> data;    // Row-major words, bit i of word w is column 64 * w + i
+
+	/**
+	 * @brief Clear the bits past the last column, so that counts and NOT stay exact.
+	 */
+	void clearPadding();
+};
@@ -1,22 +1,109 @@
 #pragma once
 
+#include <string>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
 
+#include "Deadline.hpp"
+#include "Resources.hpp"
+
 class BoundingBoxes
 {
 public:
 	/**
 	 * @brief Construct a new Bounding Boxes object, detecting the general location of the plates, the salad and the bread.
 	 * @param input The input image.
+	 * @param r The lookup tables and structuring elements to use.
+	 * @param bread False to leave the bread to a later call to detectBread, e.g. once the plates are segmented.
 	 */
-	BoundingBoxes(const cv::Mat& input);
+	BoundingBoxes(const cv::Mat& input, const Resources& r = Resources::shared(), bool bread = true);
+	/**
+	 * @brief Construct a new Bounding Boxes object from previously computed results (e.g. restored from the cache).
+	 * @param input The input image.
+	 * @param p The plates circles.
+	 * @param s The salad <found, circle>.
+	 * @param b The bread <found, mask>.
+	 */
+	BoundingBoxes(const cv::Mat& input, const std::vector<cv::Vec3f>& p, const std::pair<bool, cv::Vec3f>& s, const std::pair<bool, cv::Mat>& b);
 	std::vector<cv::Vec3f> getPlates() const { return plates; }
 	std::pair<bool, cv::Vec3f> getSalad() const { return salad; }
 	std::pair<bool, cv::Mat> getBread() const { return bread; }
+	/**
+	 * @brief Detect the bread outside of the plates and the salad. Its grabCut refinement runs only if the deadline leaves time for it:
+	 * otherwise the coarse candidate of findBread is the bread.
+	 * @param r The lookup tables and structuring elements to use.
+	 * @param deadline The latency budget of the image, unlimited if null.
+	 */
+	void detectBread(const Resources& r = Resources::shared(), Deadline* deadline = nullptr);
+	/**
+	 * @brief Textual description of every parameter that affects the detection, used to invalidate cached results.
+	 * @return The parameters string.
+	 */
+	static std::string parameters();
+
+	/**
+	 * @brief Detect the circles of plates and bowls with the Hough transform.
+	 * @param image The input image.
+	 * @param plates The output plates circles.
+	 * @param bowls The output bowls circles.
+	 * @param r The pixel parameters to use.
+	 */
+	static void detectCircles(const cv::Mat& image, std::vector<cv::Vec3f>& plates, std::vector<cv::Vec3f>& bowls, const Resources& r = Resources::shared());
+	/**
+	 * @brief Find the bread candidate region outside of plates and salad, by thresholding and morphology.
+	 * @param image The input image.
+	 * @param plates The plates circles.
+	 * @param salad The salad <found, circle>.
+	 * @param candidate The output candidate mask.
+	 * @param box The output bounding box of the candidate.
+	 * @param r The lookup tables and structuring elements to use.
+	 * @return True if a candidate was found.
+	 */
+	static bool findBread(const cv::Mat& image, const std::vector<cv::Vec3f>& plates, const std::pair<bool, cv::Vec3f>& salad, cv::Mat& candidate, cv::Rect& box, const Resources& r = Resources::shared());
+	/**
+	 * @brief Refine the bread candidate with grabCut.
+	 * @param image The input image.
+	 * @param plates The plates circles.
+	 * @param salad The salad <found, circle>.
+	 * @param candidate The candidate mask, as computed by findBread.
+	 * @param box The bounding box of the candidate, as computed by findBread.
+	 * @param r The pixel parameters to use.
+	 * @return <found, mask> of the bread.
+	 */
+	static std::pair<bool, cv::Mat> grabBread(const cv::Mat& image, const std::vector<cv::Vec3f>& plates, const std::pair<bool, cv::Vec3f>& salad, const cv::Mat& candidate, const cv::Rect& box, const Resources& r = Resources::shared());
+
+	// Plates and salad detection, pixel sizes at the dataset resolution (see Resources for the scaled ones)
+	static constexpr unsigned int GAUSSIAN_BLUR_KERNEL_SIZE = 5;
+	static constexpr double GAUSSIAN_BLUR_SIGMA = 2;
+	static constexpr unsigned int HOUGH_CANNY_THRESHOLD = 60;
+	static constexpr unsigned int HOUGH_CIRCLE_ROUNDNESS = 70;
+	static constexpr unsigned int PLATES_MIN_RADIUS = 240;
+	static constexpr unsigned int PLATES_MAX_RADIUS = 325;
+	static constexpr unsigned int BOWL_MIN_RADIUS = 170;
+	static constexpr unsigned int BOWL_MAX_RADIUS = 220;
+	static constexpr unsigned int MIN_DISTANCE_BETWEEN_CIRCLES = 300;
+	static constexpr unsigned int BREAD_FACTOR = 3;
+
+	// Bread detection
+	static constexpr double GAMMA = 0.5;
+	static constexpr unsigned int CLOSE_KERNEL_SIZE = 9;
+	static constexpr unsigned int DILATE_KERNEL_SIZE = 5;
+	static constexpr unsigned int MIN_AREA_THRESHOLD = 6000;
+	static constexpr unsigned int MAX_AREA_THRESHOLD = 60000;
+	static constexpr unsigned int MIN_SIZE = 100;
+	static constexpr unsigned int CIRCLE_NEIGHBORHOOD = 5;
+	static constexpr unsigned int SATURATION_THRESHOLD = 30;
+	static constexpr unsigned int NIBLACK_BLOCK_SIZE = 19;
+	static constexpr double NIBLACK_K = 0.7;
+	static constexpr unsigned int GRABCUT_ITERATIONS = 5;
 
 private:
+	/**
+	 * @brief Copy of the image with plates and salad painted black.
+	 */
+	static cv::Mat removeCircles(const cv::Mat& image, const std::vector<cv::Vec3f>& plates, const std::pair<bool, cv::Vec3f>& salad);
+
 	const cv::Mat source_image;
 	std::vector<cv::Vec3f> plates;      // [circles]
 	std::pair<bool, cv::Vec3f> salad;   // <found, circle>
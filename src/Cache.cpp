@@ -0,0 +1,160 @@
+#include "Cache.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#define DEBUG false
+
+Cache::Cache(const std::string& p)
+	: path(p)
+{
+	// One sub-directory for each stage
+	for (const auto& stage : { "boxes/", "labels/", "segments/" })
+		if (!std::filesystem::exists(path + stage)) std::filesystem::create_directories(path + stage);
+}
+
+std::string Cache::hash(const std::string& data)
+{
+	// 64-bit FNV-1a
+	uint64_t h = 14695981039346656037ull;
+	for (const unsigned char c : data)
+	{
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+
+	std::ostringstream oss;
+	oss << std::hex << h;
+	return oss.str();
+}
+
+std::string Cache::hashFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return "";
+
+	std::string data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	return hash(data);
+}
+
+std::string Cache::key(const std::vector<std::string>& parts)
+{
+	std::string data;
+	for (const auto& part : parts)
+		data += part + '\n';   // Separator, so that ("ab", "c") and ("a", "bc") differ
+
+	return hash(data);
+}
+
+bool Cache::getBoundingBoxes(const std::string& key, std::vector<cv::Vec3f>& plates, std::pair<bool, cv::Vec3f>& salad, std::pair<bool, cv::Mat>& bread) const
+{
+	const std::string file = path + "boxes/" + key;
+	if (!std::filesystem::exists(file + ".yml"))
+		return false;
+
+	cv::FileStorage fs(file + ".yml", cv::FileStorage::READ);
+	fs["plates"] >> plates;
+	salad.first = (int)fs["salad_found"];
+	fs["salad"] >> salad.second;
+	bread.first = (int)fs["bread_found"];
+	bread.second = bread.first ? cv::imread(file + "_bread.png", cv::IMREAD_GRAYSCALE) : cv::Mat();
+	fs.release();
+
+	if (DEBUG) std::cout << "Cache hit (boxes): " << key << std::endl;
+
+	return !bread.first || !bread.second.empty();
+}
+
+void Cache::putBoundingBoxes(const std::string& key, const BoundingBoxes& bb) const
+{
+	const std::string file = path + "boxes/" + key;
+
+	// Mask first, so that an interrupted write never leaves a valid entry behind
+	std::pair<bool, cv::Mat> bread = bb.getBread();
+	if (bread.first) cv::imwrite(file + "_bread.png", bread.second);
+
+	cv::FileStorage fs(file + ".yml", cv::FileStorage::WRITE);
+	fs << "plates" << bb.getPlates();
+	fs << "salad_found" << (int)bb.getSalad().first;
+	fs << "salad" << bb.getSalad().second;
+	fs << "bread_found" << (int)bread.first;
+	fs.release();
+}
+
+bool Cache::getLabels(const std::string& key, std::map<std::string, std::vector<int>>& labels) const
+{
+	const std::string file = path + "labels/" + key;
+	if (!std::filesystem::exists(file + ".yml"))
+		return false;
+
+	cv::FileStorage fs(file + ".yml", cv::FileStorage::READ);
+	for (const auto& node : fs["plates"])
+	{	// For each plate cutout 'node' of the tray
+		std::vector<int> l;
+		node["labels"] >> l;
+		labels[(std::string)node["name"]] = l;
+	}
+	fs.release();
+
+	if (DEBUG) std::cout << "Cache hit (labels): " << key << std::endl;
+
+	return true;
+}
+
+void Cache::putLabels(const std::string& key, const std::map<std::string, std::vector<int>>& labels) const
+{
+	cv::FileStorage fs(path + "labels/" + key + ".yml", cv::FileStorage::WRITE);
+	fs << "plates" << "[";
+	for (const auto& [name, l] : labels)
+		fs << "{" << "name" << name << "labels" << l << "}";
+	fs << "]";
+	fs.release();
+}
+
+bool Cache::getSegments(const std::string& key, cv::Mat& segments, std::vector<std::pair<int, cv::Rect>>& boxes) const
+{
+	const std::string file = path + "segments/" + key;
+	if (!std::filesystem::exists(file + ".yml"))
+		return false;
+
+	segments = cv::imread(file + ".png", cv::IMREAD_GRAYSCALE);
+
+	std::vector<int> labels;
+	std::vector<cv::Rect> rects;
+	cv::FileStorage fs(file + ".yml", cv::FileStorage::READ);
+	fs["labels"] >> labels;
+	fs["boxes"] >> rects;
+	fs.release();
+	for (int i = 0; i < labels.size() && i < rects.size(); i++)
+		boxes.push_back(std::make_pair(labels[i], rects[i]));
+
+	if (DEBUG) std::cout << "Cache hit (segments): " << key << std::endl;
+
+	return !segments.empty();
+}
+
+void Cache::putSegments(const std::string& key, const cv::Mat& segments, const std::vector<std::pair<int, cv::Rect>>& boxes) const
+{
+	const std::string file = path + "segments/" + key;
+
+	std::vector<int> labels;
+	std::vector<cv::Rect> rects;
+	for (const auto& box : boxes)
+	{
+		labels.push_back(box.first);
+		rects.push_back(box.second);
+	}
+
+	// Mask first, so that an interrupted write never leaves a valid entry behind
+	cv::imwrite(file + ".png", segments);
+
+	cv::FileStorage fs(file + ".yml", cv::FileStorage::WRITE);
+	fs << "labels" << labels;
+	fs << "boxes" << rects;
+	fs.release();
+}
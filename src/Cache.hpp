@@ -0,0 +1,65 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "BoundingBoxes.hpp"
+
+class Cache
+{
+public:
+	/**
+	 * @brief Construct a new Cache object, a content-addressed store for the results of the expensive stages.
+	 * @param p The directory where the results are stored.
+	 */
+	Cache(const std::string& p);
+
+	/**
+	 * @brief Hash of a string (64-bit FNV-1a), as hexadecimal string.
+	 * @param data The data to hash.
+	 * @return The hash.
+	 */
+	static std::string hash(const std::string& data);
+	/**
+	 * @brief Hash of the bytes of a file, as hexadecimal string.
+	 * @param path The path of the file.
+	 * @return The hash, or an empty string if the file cannot be read.
+	 */
+	static std::string hashFile(const std::string& path);
+	/**
+	 * @brief Key of a stage result, combining the hashes of its inputs and its parameters.
+	 * @param parts The inputs and parameters of the stage.
+	 * @return The key.
+	 */
+	static std::string key(const std::vector<std::string>& parts);
+
+	/**
+	 * @brief BoundingBoxes stage: circles of plates and salad, bread mask.
+	 * @param key The key of the image.
+	 * @return True if found, filling the output parameters.
+	 */
+	bool getBoundingBoxes(const std::string& key, std::vector<cv::Vec3f>& plates, std::pair<bool, cv::Vec3f>& salad, std::pair<bool, cv::Mat>& bread) const;
+	void putBoundingBoxes(const std::string& key, const BoundingBoxes& bb) const;
+
+	/**
+	 * @brief CLIP stage: labels of every plate cutout of a tray, by cutout path.
+	 * @param key The key of the tray.
+	 * @return True if found, filling the output parameter.
+	 */
+	bool getLabels(const std::string& key, std::map<std::string, std::vector<int>>& labels) const;
+	void putLabels(const std::string& key, const std::map<std::string, std::vector<int>>& labels) const;
+
+	/**
+	 * @brief Segmentation stage: segments mask and labeled boxes of a plate.
+	 * @param key The key of the plate.
+	 * @return True if found, filling the output parameters.
+	 */
+	bool getSegments(const std::string& key, cv::Mat& segments, std::vector<std::pair<int, cv::Rect>>& boxes) const;
+	void putSegments(const std::string& key, const cv::Mat& segments, const std::vector<std::pair<int, cv::Rect>>& boxes) const;
+
+private:
+	const std::string path;
+};
@@ -0,0 +1,150 @@
+#include "Classifier.hpp"
+
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+
+#define DEBUG false
+
+void Classifier::initialize(const std::string& path)
+{
+	if (Py_IsInitialized()) return;
+	Py_Initialize();
+	PyRun_SimpleString("import sys");
+	PyRun_SimpleString(("sys.path.append('" + path + "')").c_str());
+	PyRun_SimpleString("sys.argv = ['CLIP_interface.py']");
+	main_state = PyEval_SaveThread();   // Release the GIL, every call takes it back with PyGILState_Ensure
+}
+
+void Classifier::finalize()
+{
+	if (!Py_IsInitialized()) return;
+	PyEval_RestoreThread(main_state);
+	main_state = nullptr;
+	Py_Finalize();
+}
+
+Classifier::Classifier()
+{
+	PyGILState_STATE gil = PyGILState_Ensure();
+	module = PyImport_ImportModule("CLIP_interface");
+	if (module)
+	{
+		plates_func = PyObject_GetAttrString(module, "plates");
+		classify_func = PyObject_GetAttrString(module, "classify");
+	}
+	if (!plates_func || !classify_func)
+	{
+		PyErr_Print();
+		Py_XDECREF(plates_func);
+		Py_XDECREF(classify_func);
+		Py_XDECREF(module);
+		PyGILState_Release(gil);
+		throw std::runtime_error("Classifier: cannot import CLIP_interface");
+	}
+	PyGILState_Release(gil);
+}
+
+Classifier::~Classifier()
+{
+	if (!Py_IsInitialized()) return;   // Nothing to release after finalize
+	PyGILState_STATE gil = PyGILState_Ensure();
+	Py_XDECREF(classify_func);
+	Py_XDECREF(plates_func);
+	Py_XDECREF(module);
+	PyGILState_Release(gil);
+}
+
+void Classifier::plates(int tray) const
+{
+	Profiler::Scope scope(Profiler::CLIP);
+	PyGILState_STATE gil = PyGILState_Ensure();
+	PyObject* result = PyObject_CallFunction(plates_func, "i", tray);
+	if (!result) PyErr_Print();
+	Py_XDECREF(result);
+	PyGILState_Release(gil);
+}
+
+std::vector<int> Classifier::classify(const cv::Mat& plate, const std::vector<int>& candidates) const
+{
+	Profiler::Scope scope(Profiler::CLIP);
+	thread_local std::vector<float> tensor(3 * INPUT_SIZE * INPUT_SIZE);   // Preallocated once per thread, outside of the GIL
+	preprocess(plate, tensor.data());
+	const std::string key = hash(plate);
+
+	std::vector<int> labels;
+	PyGILState_STATE gil = PyGILState_Ensure();
+	PyObject* data = PyMemoryView_FromMemory(reinterpret_cast<char*>(tensor.data()), tensor.size() * sizeof(float), PyBUF_WRITE);
+	PyObject* key_string = PyUnicode_FromString(key.c_str());
+	PyObject* list = PyList_New(candidates.size());
+	for (size_t i = 0; i < candidates.size(); i++)
+		PyList_SetItem(list, i, PyLong_FromLong(candidates[i]));
+	PyObject* result = PyObject_CallFunctionObjArgs(classify_func, data, key_string, list, NULL);
+	if (result)
+	{
+		for (Py_ssize_t i = 0; i < PyList_Size(result); i++)
+			labels.push_back(PyLong_AsLong(PyList_GetItem(result, i)));
+	}
+	else PyErr_Print();
+	Py_XDECREF(result);
+	Py_DECREF(list);
+	Py_DECREF(key_string);
+	Py_DECREF(data);
+	PyGILState_Release(gil);
+
+	return labels;
+}
+
+void Classifier::preprocess(const cv::Mat& image, float* tensor)
+{
+	// Shorter side to INPUT_SIZE: area averaging when shrinking, like the antialiased bicubic of PIL, bicubic when enlarging
+	const double factor = double(INPUT_SIZE) / std::min(image.cols, image.rows);
+	const cv::Size size(std::max(INPUT_SIZE, int(image.cols * factor)), std::max(INPUT_SIZE, int(image.rows * factor)));
+	cv::Mat resized;
+	cv::resize(image, resized, size, 0, 0, factor < 1 ? cv::INTER_AREA : cv::INTER_CUBIC);
+
+	// Center crop, as a view
+	const int x = int(std::lround((resized.cols - INPUT_SIZE) / 2.0)), y = int(std::lround((resized.rows - INPUT_SIZE) / 2.0));
+	const cv::Mat crop = resized(cv::Rect(x, y, INPUT_SIZE, INPUT_SIZE));
+
+	// (v / 255 - mean) / std as a single multiply-add per channel, BGR pixels to RGB planes
+	float scale[3], offset[3];
+	for (int c = 0; c < 3; c++)
+	{
+		scale[c] = 1.0f / (255.0f * STD[c]);
+		offset[c] = -MEAN[c] / STD[c];
+	}
+	float* r = tensor;
+	float* g = tensor + INPUT_SIZE * INPUT_SIZE;
+	float* b = tensor + 2 * INPUT_SIZE * INPUT_SIZE;
+	for (int i = 0; i < INPUT_SIZE; i++, r += INPUT_SIZE, g += INPUT_SIZE, b += INPUT_SIZE)
+	{
+		const uchar* p = crop.ptr<uchar>(i);
+		for (int j = 0; j < INPUT_SIZE; j++)
+		{
+			b[j] = p[3 * j] * scale[2] + offset[2];
+			g[j] = p[3 * j + 1] * scale[1] + offset[1];
+			r[j] = p[3 * j + 2] * scale[0] + offset[0];
+		}
+	}
+}
+
+std::string Classifier::hash(const cv::Mat& image)
+{
+	// Sign of the horizontal gradient of the 9x8 grayscale image
+	cv::Mat gray, small;
+	cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+	cv::resize(gray, small, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+	uint64_t bits = 0;
+	for (int y = 0; y < 8; y++)
+		for (int x = 0; x < 8; x++)
+			bits = (bits << 1) | (small.at<uchar>(y, x) > small.at<uchar>(y, x + 1));
+
+	char key[24];
+	std::snprintf(key, sizeof(key), "cv:%016llx", static_cast<unsigned long long>(bits));   // Apart from the hashes of the PIL images
+	return key;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <Python.h>
+
+class Classifier
+{
+public:
+	/**
+	 * @brief Initialize the embedded interpreter, once per process and before any Classifier is created. The GIL is released on return so that classifiers can be used from any thread.
+	 * @param path The directory of CLIP_interface.py.
+	 */
+	static void initialize(const std::string& path = "./Python/");
+	/**
+	 * @brief Finalize the embedded interpreter, once per process and from the thread that initialized it.
+	 */
+	static void finalize();
+
+	/**
+	 * @brief Construct a new Classifier object, importing the CLIP interface. The model itself is loaded on the first classification.
+	 */
+	Classifier();
+	~Classifier();
+	Classifier(const Classifier&) = delete;
+	Classifier& operator=(const Classifier&) = delete;
+
+	/**
+	 * @brief Label all the plates cutouts of a tray, reading them from ./plates/ and writing the labels to ./labels/.
+	 * @param tray The tray number.
+	 */
+	void plates(int tray) const;
+	/**
+	 * @brief Label a single plate cutout in memory. It is preprocessed here and handed to Python as a tensor, without copy.
+	 * @param plate The plate cutout.
+	 * @param candidates The labels the plate can have (e.g. the ones found in the food image of the tray), all of them if empty.
+	 * @return The labels of the plate.
+	 */
+	std::vector<int> classify(const cv::Mat& plate, const std::vector<int>& candidates = {}) const;
+
+	/**
+	 * @brief CLIP preprocessing of a BGR image: resize of the shorter side to INPUT_SIZE, center crop, RGB, mean and std normalization.
+	 * The normalization is fused with the conversion to float and written straight into the planes of the tensor.
+	 * Python/validate_preprocess.py checks that it leads to the same labels as the PIL preprocessing of CLIP.
+	 * @param image The BGR image.
+	 * @param tensor The float32 1x3xINPUT_SIZExINPUT_SIZE (NCHW) tensor to fill.
+	 */
+	static void preprocess(const cv::Mat& image, float* tensor);
+	/**
+	 * @brief Difference hash of an image, the key of its features in the embedding cache of the CLIP interface.
+	 * @param image The BGR image.
+	 * @return The hash.
+	 */
+	static std::string hash(const cv::Mat& image);
+
+	static constexpr int INPUT_SIZE = 224;                                                   // Side of the input of the ViT-B/32 encoder
+	static constexpr float MEAN[3] = { 0.48145466f, 0.4578275f, 0.40821073f };               // RGB mean of the CLIP normalization
+	static constexpr float STD[3] = { 0.26862954f, 0.26130258f, 0.27577711f };               // RGB standard deviation of the CLIP normalization
+
+private:
+	PyObject* module = nullptr;          // CLIP_interface module
+	PyObject* plates_func = nullptr;     // CLIP_interface.plates
+	PyObject* classify_func = nullptr;   // CLIP_interface.classify
+
+	static inline PyThreadState* main_state = nullptr;   // State of the initializing thread while the GIL is released
+};
@@ -0,0 +1,71 @@
+#include "Context.hpp"
+
+#include "BoundingBoxes.hpp"
+#include "Segmentation.hpp"
+#include "Utils.hpp"
+#include "Tray.hpp"
+#include "ThreadBudget.hpp"
+
+#include <future>
+#include <stdexcept>
+
+#define DEBUG false
+
+Context::Context(bool classify, double scale, std::chrono::milliseconds d)
+	: resources(scale), deadline(d)
+{
+	if (classify) classifier = std::make_unique<Classifier>();
+}
+
+Context::Result Context::process(const cv::Mat& image, const std::vector<int>& candidates, Governor::Ticket* ticket)
+{
+	if (!classifier) throw std::logic_error("Context: no classifier, use processLabeled");
+	return processLabeled(image, [&](const cv::Vec3f& plate) -> std::vector<int>
+	{
+		return classifier->classify(utils::cutout(image, plate), candidates);
+	}, ticket);
+}
+
+Context::Result Context::processLabeled(const cv::Mat& image, const std::function<std::vector<int>(const cv::Vec3f&)>& labeler, Governor::Ticket* ticket)
+{
+	Deadline budget(deadline);   // Started before any work on the image
+
+	// Processing resolution
+	cv::Mat input = image;
+	if (resources.scale != 1.0) cv::resize(image, input, cv::Size(), resources.scale, resources.scale, cv::INTER_AREA);
+
+	Result result;
+	BoundingBoxes bb(input, resources, false);   // The bread is optional, it waits for the plates
+	const std::vector<cv::Vec3f> plates = bb.getPlates();
+	if (ticket) ticket->update(image.size(), (int)plates.size());   // The plates are segmented concurrently, each with its buffers
+	for (const auto& plate : plates)
+		result.plates.push_back(cv::Vec3f(plate[0] / resources.scale, plate[1] / resources.scale, plate[2] / resources.scale));
+
+	// Labels first, in the order of the plates, then the plates are segmented concurrently
+	for (const auto& plate : result.plates)
+		result.labels.push_back(labeler(plate));
+	std::vector<std::future<Segmentation>> tasks;
+	for (size_t j = 0; j < plates.size(); j++)
+		tasks.push_back(ThreadBudget::spawn([&, j]() -> Segmentation
+		{
+			cv::Mat cutout = utils::cutout(input, plates[j]);
+			return Segmentation(cutout, result.labels[j], resources, &budget);
+		}));
+
+	std::vector<cv::Mat> masks;
+	std::vector<std::vector<std::pair<int, cv::Rect>>> boxes;
+	for (auto& task : tasks)
+	{
+		Segmentation seg = task.get();
+		masks.push_back(seg.getSegments());
+		boxes.push_back(seg.getBoxes());
+	}
+
+	bb.detectBread(resources, &budget);
+	Tray tray(input, bb, masks, boxes, resources, &budget);
+	result.mask = tray.getMask();
+	result.boxes = tray.getBoxes();
+	result.skipped = budget.getSkipped();
+	utils::rescale(result.mask, result.boxes, image.size());
+	return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <memory>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Classifier.hpp"
+#include "Deadline.hpp"
+#include "Governor.hpp"
+#include "Resources.hpp"
+
+class Context
+{
+public:
+	/**
+	 * @brief Result of the processing of a tray image.
+	 */
+	struct Result
+	{
+		cv::Mat mask;                                  // Label map of the tray, one label per pixel
+		std::vector<std::pair<int, cv::Rect>> boxes;   // Labeled bounding boxes of the tray
+		std::vector<cv::Vec3f> plates;                 // Plates found in the image, in its coordinates
+		std::vector<std::vector<int>> labels;          // Labels of each plate
+		std::vector<std::string> skipped;              // Refinements skipped to meet the deadline, their coarse fallback is in the mask
+	};
+
+	/**
+	 * @brief Construct a new Context object, holding the resources and the classifier session reused by every call.
+	 * Not thread-safe itself: use one context per thread.
+	 * @param classify True to create a classifier session, which requires Classifier::initialize to have been called.
+	 * @param scale The processing scale: the image is processed downscaled by it, then the results are brought back to its resolution.
+	 * @param deadline The latency budget of each image, unlimited if 0: the plates are segmented first, then the bread, the salad and the beans
+	 * are refined only if they are expected to end in time.
+	 */
+	Context(bool classify = true, double scale = 1.0, std::chrono::milliseconds deadline = std::chrono::milliseconds(0));
+
+	/**
+	 * @brief Process a tray image in memory, without touching the filesystem.
+	 * @param image The tray image.
+	 * @param candidates The labels the plates can have (e.g. the ones found in the food image of the tray), all of them if empty.
+	 * @param ticket The memory reservation of the image, refined with the number of plates once detected, if not null.
+	 * @return The label map and the boxes of the tray.
+	 */
+	Result process(const cv::Mat& image, const std::vector<int>& candidates = {}, Governor::Ticket* ticket = nullptr);
+	/**
+	 * @brief Process a tray image in memory, with the labels of each plate already known.
+	 * @param image The tray image.
+	 * @param labeler Function returning the labels of a plate given its circle, in the coordinates of the image.
+	 * @param ticket The memory reservation of the image, refined with the number of plates once detected, if not null.
+	 * @return The label map and the boxes of the tray.
+	 */
+	Result processLabeled(const cv::Mat& image, const std::function<std::vector<int>(const cv::Vec3f&)>& labeler, Governor::Ticket* ticket = nullptr);
+
+	const Resources& getResources() const { return resources; }
+
+private:
+	Resources resources;                      // Lookup tables, structuring elements and colour tables
+	std::unique_ptr<Classifier> classifier;   // Classifier session, null if disabled
+	std::chrono::milliseconds deadline;       // Latency budget of each image, unlimited if 0
+};
@@ -0,0 +1,65 @@
+#include "Deadline.hpp"
+
+#include <algorithm>
+
+#define DEBUG false
+
+std::atomic<long long> Deadline::expected[STEPS] = {
+	std::chrono::microseconds(BREAD_COST).count(),
+	std::chrono::microseconds(SALAD_COST).count(),
+	std::chrono::microseconds(BEANS_COST).count()
+};
+
+Deadline::Deadline(std::chrono::milliseconds budget)
+	: end(std::chrono::steady_clock::now() + budget), limited(budget.count() > 0)
+{
+}
+
+bool Deadline::run(Step step, const std::function<void()>& refinement)
+{
+	const auto start = std::chrono::steady_clock::now();
+	if (limited && start + std::chrono::microseconds(expected[step].load(std::memory_order_relaxed)) > end)
+	{
+		skipped.fetch_or(1u << step, std::memory_order_relaxed);
+
+		// A skip measures nothing: the expectation decays instead, so that one slow run cannot disable the step for good
+		// and the step is probed again after a few skips
+		const long long previous = expected[step].load(std::memory_order_relaxed);
+		expected[step].store(previous * SMOOTHING / (SMOOTHING + 1), std::memory_order_relaxed);
+		return false;
+	}
+
+	refinement();
+
+	// Concurrent updates may lose one of the measures, the expectation stays an average of the recent ones
+	const long long measured = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	const long long previous = expected[step].load(std::memory_order_relaxed);
+	expected[step].store((previous * SMOOTHING + measured) / (SMOOTHING + 1), std::memory_order_relaxed);
+	return true;
+}
+
+std::chrono::milliseconds Deadline::getRemaining() const
+{
+	if (!limited) return std::chrono::milliseconds::max();
+	return std::max(std::chrono::milliseconds(0), std::chrono::duration_cast<std::chrono::milliseconds>(end - std::chrono::steady_clock::now()));
+}
+
+std::vector<std::string> Deadline::getSkipped() const
+{
+	std::vector<std::string> names;
+	const unsigned steps = skipped.load(std::memory_order_relaxed);
+	for (int step = 0; step < STEPS; step++)
+		if (steps & (1u << step)) names.push_back(name(Step(step)));
+	return names;
+}
+
+const char* Deadline::name(Step step)
+{
+	switch (step)
+	{
+	case BREAD: return "bread";
+	case SALAD: return "salad";
+	case BEANS: return "beans";
+	default:    return "unknown";
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Deadline
+{
+public:
+	/**
+	 * @brief Optional refinements, run only if they are expected to end before the deadline.
+	 */
+	enum Step { BREAD, SALAD, BEANS, STEPS };
+
+	/**
+	 * @brief Construct a new Deadline object, starting the latency budget of an image: the plates are always segmented,
+	 * the refinements that would not end in time are skipped and their coarse fallback is used instead.
+	 * @param budget The latency budget from now, unlimited if 0.
+	 */
+	Deadline(std::chrono::milliseconds budget = std::chrono::milliseconds(0));
+
+	/**
+	 * @brief Run a refinement if its expected duration fits in the time left, from any thread. Its duration updates the expectation,
+	 * a skip decays it by the same smoothing so that the refinement is tried again once the expectation fits.
+	 * @param step The refinement.
+	 * @param refinement The work of the refinement.
+	 * @return True if it ran, false if it was skipped.
+	 */
+	bool run(Step step, const std::function<void()>& refinement);
+
+	bool isLimited() const { return limited; }
+	std::chrono::milliseconds getRemaining() const;
+	/**
+	 * @brief Names of the refinements skipped so far, in the order of the steps.
+	 * @return The names, empty if none was skipped.
+	 */
+	std::vector<std::string> getSkipped() const;
+	static const char* name(Step step);
+
+	// Expected durations before the first measures, at the dataset resolution
+	static constexpr std::chrono::milliseconds BREAD_COST{ 250 };   // GrabCut of the bread candidate outside of the plates
+	static constexpr std::chrono::milliseconds SALAD_COST{ 30 };    // Equalization, thresholding and morphology of the bowl
+	static constexpr std::chrono::milliseconds BEANS_COST{ 40 };    // Beans mask, opening and largest component of a plate
+	static constexpr int SMOOTHING = 8;                              // Weight of the past durations in the expectation, vs 1 for the new one
+
+private:
+	std::chrono::steady_clock::time_point end;
+	bool limited;
+	std::atomic<unsigned> skipped{ 0 };                  // Bit set of the skipped steps
+	static std::atomic<long long> expected[STEPS];       // Expected duration of each step in microseconds, shared by all the images
+};
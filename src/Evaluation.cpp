@@ -0,0 +1,113 @@
+#include "Evaluation.hpp"
+
+#include "Utils.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#define DEBUG false
+
+Evaluation::Evaluation(const std::string& dataset, int trays)
+{
+	for (int i = 1; i <= trays; i++)
+	{	// For each tray [i]
+		truth.emplace_back();
+		for (const auto& imgname : IMAGE_NAMES)
+		{
+			const std::string tray = dataset + "tray" + std::to_string(i) + "/";
+			const std::string mask_path = tray + "masks/" + imgname + (imgname == "food_image" ? "_mask" : "") + ".png";
+			cv::Mat mask = cv::imread(mask_path, cv::IMREAD_GRAYSCALE);
+			if (mask.empty()) throw std::runtime_error("Evaluation: missing ground truth " + mask_path);
+			truth.back().emplace_back(mask, utils::readBoxes(tray + "bounding_boxes/" + imgname + "_bounding_box.txt"));
+		}
+	}
+}
+
+Metrics Evaluation::evaluate(const std::string& run) const
+{
+	Metrics::Data data;
+	for (size_t i = 0; i < truth.size(); i++)
+	{	// For each tray [i], the ground truth is shared, not copied
+		data.emplace_back();
+		for (size_t j = 0; j < IMAGE_NAMES.size(); j++)
+		{
+			const std::string tray = run + "tray" + std::to_string(i + 1) + "/";
+			const std::string mask_path = tray + "masks/" + IMAGE_NAMES[j] + "_mask.png";
+			cv::Mat mask = cv::imread(mask_path, cv::IMREAD_GRAYSCALE);
+			if (mask.empty()) throw std::runtime_error("Evaluation: missing prediction " + mask_path);
+			data.back().emplace_back(mask, utils::readBoxes(tray + "bounding_boxes/" + IMAGE_NAMES[j] + "_bounding_boxes.txt"), truth[i][j].first, truth[i][j].second);
+		}
+	}
+	return Metrics(data, "");
+}
+
+int Evaluation::compare(const std::vector<std::string>& runs, const std::string& report) const
+{
+	// Runs in parallel, each one reads its predictions and computes its metrics
+	std::vector<std::future<Metrics>> tasks;
+	for (const auto& run : runs)
+		tasks.push_back(std::async(std::launch::async, [this, run]() -> Metrics { return evaluate(run); }));
+
+	std::vector<std::pair<std::string, std::unique_ptr<Metrics>>> results;   // <run, metrics or null if failed>
+	std::string errors;
+	for (size_t r = 0; r < runs.size(); r++)
+	{
+		try
+		{
+			results.emplace_back(runs[r], std::make_unique<Metrics>(tasks[r].get()));
+		}
+		catch (const std::exception& e)
+		{
+			results.emplace_back(runs[r], nullptr);
+			errors += runs[r] + ": " + e.what() + "\n";
+		}
+	}
+
+	std::ostringstream text;
+	text << std::fixed << std::setprecision(4);
+	text << "Evaluation of " << runs.size() << " runs" << std::endl << std::endl;
+	for (size_t r = 0; r < results.size(); r++)
+	{
+		const auto& [run, metrics] = results[r];
+		text << "[" << r + 1 << "] " << run;
+		if (metrics) text << "  mAP: " << metrics->getMeanAveragePrecision() << "  mIoU: " << metrics->getMeanIoUOverall() << std::endl;
+		else text << "  failed" << std::endl;
+	}
+	text << std::endl;
+
+	// One line per class, one column per evaluated run, in the order above, even the failed ones
+	const int COLUMN = 6;   // Width of a value with 4 decimals
+	text << "Average Precision for each class:" << std::endl;
+	for (int label = 1; label < Metrics::CLASSES; label++)
+	{
+		text << "label: " << label;
+		for (const auto& [run, metrics] : results)
+			if (metrics) text << "  " << std::setw(COLUMN) << metrics->getAveragePrecision()[label];
+			else text << "  " << std::setw(COLUMN) << "-";   // Failed run, its column is kept
+		text << std::endl;
+	}
+	text << std::endl;
+	text << "Mean Intersection over Union for each class:" << std::endl;
+	for (int label = 1; label < Metrics::CLASSES; label++)
+	{
+		text << "label: " << label;
+		for (const auto& [run, metrics] : results)
+			if (metrics) text << "  " << std::setw(COLUMN) << metrics->getMeanIoU()[label];
+			else text << "  " << std::setw(COLUMN) << "-";   // Failed run, its column is kept
+		text << std::endl;
+	}
+	if (!errors.empty()) text << std::endl << "Errors:" << std::endl << errors;
+
+	std::ofstream file(report);
+	file << text.str();
+	if (DEBUG) std::cout << text.str();
+	int failures = 0;
+	for (const auto& result : results)
+		if (!result.second) failures++;
+	return failures;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Metrics.hpp"
+
+class Evaluation
+{
+public:
+	/**
+	 * @brief Construct a new Evaluation object, loading the ground truth masks and boxes of the dataset once,
+	 * so that any number of runs are evaluated against it without reading it again.
+	 * @param dataset The dataset directory, with trayN/{masks,bounding_boxes}.
+	 * @param trays The number of trays.
+	 */
+	Evaluation(const std::string& dataset, int trays = 8);
+
+	/**
+	 * @brief Evaluate the predictions of a run, sharing the loaded ground truth.
+	 * @param run The output directory of the run, with trayN/{masks,bounding_boxes} as written by the pipeline.
+	 * @return The metrics of the run, without reports written.
+	 * @throws std::runtime_error If a prediction is missing.
+	 */
+	Metrics evaluate(const std::string& run) const;
+	/**
+	 * @brief Evaluate several runs concurrently and write a combined report: mAP and mIoU of each run, then AP and mIoU of each class by run.
+	 * @param runs The output directories of the runs.
+	 * @param report The path of the combined report.
+	 * @return The number of runs that could not be evaluated.
+	 */
+	int compare(const std::vector<std::string>& runs, const std::string& report) const;
+
+	static inline const std::vector<std::string> IMAGE_NAMES = { "food_image", "leftover1", "leftover2", "leftover3" };
+
+private:
+	std::vector<std::vector<std::pair<cv::Mat, std::vector<std::pair<int, cv::Rect>>>>> truth;   // For each tray, for each image: <mask, boxes>
+};
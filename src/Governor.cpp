@@ -0,0 +1,93 @@
+#include "Governor.hpp"
+
+#include "Utils.hpp"
+
+#include <algorithm>
+
+#define DEBUG false
+
+Governor::Ticket& Governor::Ticket::operator=(Ticket&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		governor = other.governor;
+		bytes = other.bytes;
+		other.governor = nullptr;
+	}
+	return *this;
+}
+
+void Governor::Ticket::update(cv::Size size, int plates)
+{
+	if (!governor) return;
+	const size_t estimate = Governor::estimate(size, plates);
+	std::lock_guard<std::mutex> lock(governor->mutex);
+	governor->reserved = governor->reserved - bytes + estimate;
+	governor->peak = std::max(governor->peak, governor->reserved);
+	if (!size.empty()) governor->last_size = size;
+	if (estimate < bytes) governor->released.notify_all();
+	bytes = estimate;
+}
+
+void Governor::Ticket::release()
+{
+	if (!governor) return;
+	{
+		std::lock_guard<std::mutex> lock(governor->mutex);
+		governor->reserved -= bytes;
+		governor->in_flight--;
+	}
+	governor->released.notify_all();
+	governor = nullptr;
+	bytes = 0;
+}
+
+Governor::Governor(size_t b, cv::Size assumed)
+	: budget(b), baseline(utils::residentMemory()), last_size(assumed.empty() ? cv::Size(DEFAULT_WIDTH, DEFAULT_HEIGHT) : assumed)
+{
+}
+
+size_t Governor::estimate(cv::Size size, int plates)
+{
+	const double side = PLATE_DIAMETER * std::min(size.width, size.height);
+	return size_t(IMAGE_BYTES_PER_PIXEL * size.area() + PLATE_BYTES_PER_PIXEL * side * side * std::max(plates, 0));
+}
+
+Governor::Ticket Governor::admit()
+{
+	cv::Size size;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size = last_size;
+	}
+	return admit(size);
+}
+
+Governor::Ticket Governor::admit(cv::Size size, int plates)
+{
+	const size_t bytes = estimate(size, plates);
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// The reservations bound the working sets known in advance, the resident memory catches the estimates that fell short
+	auto fits = [&]() -> bool
+	{
+		if (budget == 0 || in_flight == 0) return true;
+		if (baseline + reserved + bytes > budget) return false;
+		const size_t resident = utils::residentMemory();
+		return resident + bytes <= budget;
+	};
+	if (!fits())
+	{
+		waits++;
+		while (!fits())
+			released.wait_for(lock, RECHECK);
+	}
+
+	reserved += bytes;
+	peak = std::max(peak, reserved);
+	in_flight++;
+	admitted++;
+	if (DEBUG) std::cout << "Governor: admitted " << bytes / (1 << 20) << " MiB, " << reserved / (1 << 20) << " MiB in " << in_flight << " images" << std::endl;
+	return Ticket(this, bytes);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+#include <opencv2/opencv.hpp>
+
+class Governor
+{
+public:
+	/**
+	 * @brief Reservation of the working set of an image in flight, released when destroyed.
+	 */
+	class Ticket
+	{
+	public:
+		Ticket() = default;
+		~Ticket() { release(); }
+		Ticket(Ticket&& other) noexcept : governor(other.governor), bytes(other.bytes) { other.governor = nullptr; }
+		Ticket& operator=(Ticket&& other) noexcept;
+		Ticket(const Ticket&) = delete;
+		Ticket& operator=(const Ticket&) = delete;
+
+		/**
+		 * @brief Refine the reservation once more is known about the image, without waiting: the work is already admitted,
+		 * a larger estimate delays the next admissions instead.
+		 * @param size The size of the image.
+		 * @param plates The number of plates, EXPECTED_PLATES until they are detected.
+		 */
+		void update(cv::Size size, int plates = EXPECTED_PLATES);
+		/**
+		 * @brief Release the reservation before the ticket is destroyed.
+		 */
+		void release();
+
+		size_t getBytes() const { return bytes; }
+
+	private:
+		friend class Governor;
+		Ticket(Governor* g, size_t b) : governor(g), bytes(b) {}
+		Governor* governor = nullptr;
+		size_t bytes = 0;
+	};
+
+	/**
+	 * @brief Construct a new Governor object, admitting images into the pipeline only while the estimated working sets of the images
+	 * in flight fit in a resident memory budget, so that the input stage waits instead of the process being killed when out of memory.
+	 * The resident memory at construction (models, resources) is taken as the baseline the working sets come on top of.
+	 * @param budget The budget of resident memory of the process, in bytes, unlimited if 0.
+	 * @param assumed The size assumed by admit() until the first image is known, the one of the dataset images by default.
+	 */
+	Governor(size_t budget = 0, cv::Size assumed = cv::Size(DEFAULT_WIDTH, DEFAULT_HEIGHT));
+
+	/**
+	 * @brief Estimate the peak working set of an image through the pipeline: the image and its image-sized temporaries
+	 * (e.g. the grabCut masks of the bread detection), the masks kept for the metrics and the cutout and clustering buffers of each plate.
+	 * @param size The size of the image.
+	 * @param plates The number of plates.
+	 * @return The estimate in bytes.
+	 */
+	static size_t estimate(cv::Size size, int plates = EXPECTED_PLATES);
+
+	/**
+	 * @brief Wait until an image fits in the budget, then reserve its working set. An image is always admitted when nothing is in flight,
+	 * even if larger than the budget. Before the size of the images is known, the one of the last update is assumed, or the one given
+	 * at construction until the first update: the reservation is never empty.
+	 * @return The reservation, to be refined with Ticket::update.
+	 */
+	Ticket admit();
+	/**
+	 * @brief Wait until an image of known size fits in the budget, then reserve its working set.
+	 * @param size The size of the image.
+	 * @param plates The number of plates, EXPECTED_PLATES if not detected yet.
+	 * @return The reservation.
+	 */
+	Ticket admit(cv::Size size, int plates = EXPECTED_PLATES);
+
+	size_t getBudget() const { return budget; }
+	size_t getBaseline() const { return baseline; }
+	size_t getPeak() const { return peak; }        // Peak of the reserved bytes
+	int getAdmitted() const { return admitted; }
+	int getWaits() const { return waits; }         // Admissions that had to wait
+
+	static constexpr int EXPECTED_PLATES = 3;                                // Plates assumed before the detection
+	static constexpr int DEFAULT_WIDTH = 1280, DEFAULT_HEIGHT = 960;         // Size of the dataset images, assumed before the first one
+	static constexpr double IMAGE_BYTES_PER_PIXEL = 24.0;                    // Image, detection and tray temporaries, metrics masks
+	static constexpr double PLATE_BYTES_PER_PIXEL = 24.0;                    // Cutout, float samples, cluster labels and masks of a plate
+	static constexpr double PLATE_DIAMETER = 0.5;                            // Plate cutout side, as a fraction of the shorter image side
+	static constexpr std::chrono::milliseconds RECHECK{ 50 };                // Time between two samples of the resident memory while waiting
+
+private:
+	size_t budget, baseline;
+	size_t reserved = 0;    // Bytes reserved by the tickets alive
+	size_t peak = 0;
+	int in_flight = 0;      // Tickets alive
+	int admitted = 0, waits = 0;
+	cv::Size last_size;     // Size of the last image, assumed by admit(), never empty
+	std::mutex mutex;
+	std::condition_variable released;
+};
@@ -0,0 +1,130 @@
+#include "Matcher.hpp"
+
+#include "Cache.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+#define DEBUG false
+
+Matcher::Matcher(const std::string& gallery, const std::string& index)
+	: histograms(CLASSES + 1)
+{
+	// The gallery crops of each class, in a stable order
+	std::vector<std::vector<std::string>> files(CLASSES + 1);
+	std::vector<std::string> parts = { parameters() };   // The signature is still empty, only the parameters
+	for (int c = 1; c <= CLASSES; c++)
+	{
+		if (!std::filesystem::exists(gallery + std::to_string(c))) continue;
+		for (const auto& entry : std::filesystem::directory_iterator(gallery + std::to_string(c)))
+			if (entry.path().extension() == ".png") files[c].push_back(entry.path().string());
+		std::sort(files[c].begin(), files[c].end());
+		for (const auto& file : files[c]) parts.push_back(file + ":" + Cache::hashFile(file));
+	}
+	signature = Cache::key(parts);
+
+	// Prebuilt index, if it was built from the same gallery
+	cv::FileStorage in(index, cv::FileStorage::READ);
+	if (in.isOpened() && (std::string)in["signature"] == signature)
+	{
+		for (int c = 1; c <= CLASSES; c++)
+			in["class" + std::to_string(c)] >> histograms[c];
+		if (DEBUG) std::cout << "Matcher: index loaded from " << index << std::endl;
+		return;
+	}
+	in.release();
+
+	// Build the index: one histogram per class, accumulated over all its crops
+	for (int c = 1; c <= CLASSES; c++)
+	{
+		cv::Mat sum;
+		for (const auto& file : files[c])
+		{
+			int pixels;
+			cv::Mat h = histogram(cv::imread(file, cv::IMREAD_UNCHANGED), pixels);
+			if (sum.empty()) sum = h;
+			else sum += h;
+		}
+		if (!sum.empty()) cv::normalize(sum, histograms[c], 1.0, 0.0, cv::NORM_L1);
+	}
+
+	cv::FileStorage out(index, cv::FileStorage::WRITE);
+	if (!out.isOpened()) return;   // The index is rebuilt on the next run
+	out << "signature" << signature;
+	for (int c = 1; c <= CLASSES; c++)
+		out << "class" + std::to_string(c) << histograms[c];
+	if (DEBUG) std::cout << "Matcher: index saved to " << index << std::endl;
+}
+
+cv::Mat Matcher::histogram(const cv::Mat& image, int& pixels)
+{
+	// Transparent pixels of the gallery crops are not food
+	cv::Mat bgr = image, alpha;
+	if (image.channels() == 4)
+	{
+		cv::extractChannel(image, alpha, 3);
+		cv::cvtColor(image, bgr, cv::COLOR_BGRA2BGR);
+	}
+
+	// Food: saturated and not dark, which leaves out the white plate, the tray and the black outside of the cutouts
+	cv::Mat hsv, mask;
+	cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
+	cv::inRange(hsv, cv::Scalar(0, MIN_SATURATION, MIN_VALUE), cv::Scalar(180, 256, 256), mask);
+	if (!alpha.empty()) cv::bitwise_and(mask, alpha > 0, mask);
+	pixels = cv::countNonZero(mask);
+
+	cv::Mat h;
+	const int channels[] = { 0, 1 };
+	const int sizes[] = { HUE_BINS, SATURATION_BINS };
+	const float hue[] = { 0, 180 }, saturation[] = { 0, 256 };
+	const float* ranges[] = { hue, saturation };
+	cv::calcHist(&hsv, 1, channels, mask, h, 2, sizes, ranges);
+	return h;
+}
+
+bool Matcher::match(const cv::Mat& plate, const std::vector<int>& candidates, std::vector<int>& labels) const
+{
+	int pixels;
+	cv::Mat h = histogram(plate, pixels);
+	if (pixels < MIN_FOOD_FRACTION * plate.total())
+	{	// Empty or almost empty plate, CLIP decides
+		rejected++;
+		return false;
+	}
+	cv::normalize(h, h, 1.0, 0.0, cv::NORM_L1);
+
+	// Best and second best class among the candidates
+	int best = 0;
+	double first = 0, second = 0;
+	for (int c = 1; c <= CLASSES; c++)
+	{
+		if (histograms[c].empty()) continue;
+		if (!candidates.empty() && std::find(candidates.begin(), candidates.end(), c) == candidates.end()) continue;
+		const double similarity = 1.0 - cv::compareHist(h, histograms[c], cv::HISTCMP_BHATTACHARYYA);
+		if (similarity > first)
+		{
+			second = first;
+			first = similarity;
+			best = c;
+		}
+		else if (similarity > second) second = similarity;
+	}
+	if (DEBUG) std::cout << "Matcher: class " << best << " similarity " << first << " margin " << first - second << std::endl;
+
+	// Only a clear first course is easy: the main and side dishes share the plate and are left to CLIP
+	if (best < 1 || best > FIRST_COURSES || first < SIMILARITY_THRESHOLD || first - second < MARGIN)
+	{
+		rejected++;
+		return false;
+	}
+	labels = { best };
+	accepted++;
+	return true;
+}
+
+std::string Matcher::parameters() const
+{
+	return "Matcher;" + std::to_string(HUE_BINS) + ";" + std::to_string(SATURATION_BINS) + ";" + std::to_string(MIN_SATURATION) + ";" + std::to_string(MIN_VALUE) + ";"
+		+ std::to_string(MIN_FOOD_FRACTION) + ";" + std::to_string(SIMILARITY_THRESHOLD) + ";" + std::to_string(MARGIN) + ";" + signature;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+class Matcher
+{
+public:
+	/**
+	 * @brief Construct a new Matcher object, a cheap colour classifier in front of CLIP. Loads the index of the gallery from disk,
+	 * or builds it from the gallery (one directory of reference crops per class) and saves it when missing or outdated.
+	 * @param gallery The gallery directory, with the crops of class i in gallery/i/.
+	 * @param index The file of the prebuilt index.
+	 */
+	Matcher(const std::string& gallery = "./matching/", const std::string& index = "./matching/index.yml");
+
+	/**
+	 * @brief Label a plate cutout when it is an easy one: a single first course, clearly closer to its class than to any other.
+	 * @param plate The plate cutout.
+	 * @param candidates The labels the plate can have, all of them if empty.
+	 * @param labels The labels of the plate, filled only when confident.
+	 * @return True if confident, false if the plate is ambiguous and must be sent to CLIP.
+	 */
+	bool match(const cv::Mat& plate, const std::vector<int>& candidates, std::vector<int>& labels) const;
+
+	/**
+	 * @brief Get the string of the parameters and of the index, to be used in the cache keys of the labels.
+	 * @return The parameters string.
+	 */
+	std::string parameters() const;
+
+	int getAccepted() const { return accepted; }
+	int getRejected() const { return rejected; }
+
+	static constexpr int HUE_BINS = 30;                     // Bins of the hue, over [0, 180)
+	static constexpr int SATURATION_BINS = 32;              // Bins of the saturation, over [0, 256)
+	static constexpr int MIN_SATURATION = 40;               // Pixels less saturated than this are plate, tray or background
+	static constexpr int MIN_VALUE = 40;                    // Pixels darker than this are background
+	static constexpr double MIN_FOOD_FRACTION = 0.05;       // Fraction of food pixels below which the plate is left to CLIP (e.g. empty plate)
+	static constexpr double SIMILARITY_THRESHOLD = 0.6;     // Similarity (1 - Bhattacharyya distance) of the best class to accept it
+	static constexpr double MARGIN = 0.1;                   // Similarity of the best class over the second one to accept it
+	static constexpr int CLASSES = 11;                      // Classes that can be found in the plates (salad and bread are detected apart)
+	static constexpr int FIRST_COURSES = 5;                 // Classes 1 to FIRST_COURSES are first courses, served alone in their plate
+
+private:
+	std::vector<cv::Mat> histograms;   // Normalized histogram of each class, empty if the class has no crops
+	std::string signature;             // Hash of the gallery the index was built from
+	mutable int accepted = 0;          // Plates labeled by the matcher
+	mutable int rejected = 0;          // Plates left to CLIP
+
+	/**
+	 * @brief Hue-saturation histogram of the food pixels of an image.
+	 * @param image The BGR or BGRA image, the transparent pixels are excluded.
+	 * @param pixels The number of food pixels.
+	 * @return The histogram, not normalized.
+	 */
+	static cv::Mat histogram(const cv::Mat& image, int& pixels);
+};
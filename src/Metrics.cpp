@@ -1,13 +1,144 @@
 #include "Metrics.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
 
 #define DEBUG false
 
-Metrics::Metrics(std::vector<std::vector<std::tuple<cv::Mat, std::vector<std::pair<int, cv::Rect>>, cv::Mat, std::vector<std::pair<int, cv::Rect>>>>>& m)
-	: metrics(m)
+Metrics::Metrics(const Data& m, const std::string& output)
+	: Metrics(partials(m), output)
 {
+}
+
+std::vector<Metrics::Partial> Metrics::partials(const Data& m)
+{
+	std::vector<Partial> result;
+	for (int i = 0; i < m.size(); i++)
+		result.push_back(partial(m[i], i + 1));
+	return result;
+}
+
+Metrics::Partial Metrics::partial(const Data::value_type& tray, int number)
+{
+	Partial p;
+	p.tray = number;
+
+	// Mask IoU and box matching
+	for (int i = 0; i < 3; i++)
+	{	// For each image [i] in the tray, except for leftover3
+		cv::Mat mask = std::get<0>(tray[i]);										     // Mask computed by segmentation
+		cv::Mat orig_mask = std::get<2>(tray[i]);									     // Mask computed by ground truth
+		std::vector<std::pair<int, cv::Rect>> labeled_box = std::get<1>(tray[i]);	     // Labels computed by segmentation
+		std::vector<std::pair<int, cv::Rect>> orig_labeled_box = std::get<3>(tray[i]);   // Labels computed by ground truth
+
+		p.labels.emplace_back();
+		p.outcomes.emplace_back();
+		p.unmatched.emplace_back();
+		p.iou.emplace_back();
+		for (const auto& olb : orig_labeled_box)
+		{	// For each label 'olb' in the ground truth
+			cv::Mat thresh_mask, thres_orig_mask;
+			cv::compare(mask, olb.first, thresh_mask, cv::CMP_EQ);
+			cv::compare(orig_mask, olb.first, thres_orig_mask, cv::CMP_EQ);
+			cv::Mat intersection = thresh_mask & thres_orig_mask;
+			cv::Mat union_ = thresh_mask | thres_orig_mask;
+
+			// Compute IoU
+			double iou = (double)cv::countNonZero(intersection) / (double)cv::countNonZero(union_);
+			p.iou.back().push_back(iou);
+		}
+
+		for (const auto& olb : orig_labeled_box)
+		{	// For each label 'olb' in the ground truth
+			p.labels.back().push_back(olb.first);
+
+			// Find label in computed labels
+			auto lb = std::find_if(labeled_box.begin(), labeled_box.end(), [olb](const std::pair<int, cv::Rect>& box) { return box.first == olb.first; });
+			if (lb == labeled_box.end())
+			{	// If label is not found
+				p.outcomes.back().push_back(Partial::FALSE_NEGATIVE);
+				continue;
+			}
+
+			cv::Rect intersection = lb->second & olb.second;				    // Compute intersection
+			cv::Rect union_ = lb->second | olb.second;						    // Compute union
+			double iou = (double)intersection.area() / (double)union_.area();   // Compute intersection over union
+
+			p.outcomes.back().push_back(iou >= 0.5 ? Partial::TRUE_POSITIVE : Partial::FALSE_POSITIVE);   // IoU threshold
+
+			labeled_box.erase(lb);   // Remove the label from the computed labels
+		}
+
+		// False positives
+		for (const auto& lb : labeled_box)
+			p.unmatched.back().push_back(lb.first);
+	}
+
+	// Food leftover
+	cv::Mat mask = std::get<0>(tray[0]);											   // Mask computed by segmentation
+	cv::Mat orig_mask = std::get<2>(tray[0]);										   // Mask computed by ground truth
+	std::vector<std::pair<int, cv::Rect>> orig_labeled_box = std::get<3>(tray[0]);   // Labels computed by ground truth
+
+	if (DEBUG) std::cout << "Tray " << number << std::endl;
+
+	for (int j = 1; j < 4; j++)
+	{	// For each image [j] in the tray, except for the first one
+		if (DEBUG) std::cout << "   Leftover " << j << std::endl;
+
+		cv::Mat mask_left = std::get<0>(tray[j]);		   // Mask computed by segmentation
+		cv::Mat orig_mask_left = std::get<2>(tray[j]);   // Mask computed by ground truth
+
+		p.leftovers.emplace_back();
+
+		// Count non zero pixels for each food type
+		for (const auto& olb : orig_labeled_box)
+		{	// For each label 'olb' in the ground truth
+			double food_pixels, orig_food_pixels;
+			double food_pixels_left, orig_food_pixels_left;
+
+			// Pixels of food in the food_tray
+			cv::Mat thresh_mask, thres_orig_mask;
+			cv::compare(mask, olb.first, thresh_mask, cv::CMP_EQ);
+			cv::compare(orig_mask, olb.first, thres_orig_mask, cv::CMP_EQ);
+			food_pixels = cv::countNonZero(thresh_mask);
+			orig_food_pixels = cv::countNonZero(thres_orig_mask);
+
+			// Pixels of food in the leftover 3
+			cv::Mat thresh_mask_left, thres_orig_mask_left;
+			cv::compare(mask_left, olb.first, thresh_mask_left, cv::CMP_EQ);
+			cv::compare(orig_mask_left, olb.first, thres_orig_mask_left, cv::CMP_EQ);
+			food_pixels_left = cv::countNonZero(thresh_mask_left);
+			orig_food_pixels_left = cv::countNonZero(thres_orig_mask_left);
+
+			// Compute estimated leftover
+			double estimated_leftover = (food_pixels_left / food_pixels);
+			double actual_leftover = (orig_food_pixels_left / orig_food_pixels);
+			if (DEBUG)
+			{
+				std::cout << "Estimated leftover of food " << olb.first << " = " << estimated_leftover << std::endl;
+				std::cout << "Actual leftover of food " << olb.first << " = " << actual_leftover << std::endl;
+				std::cout << "Difference = " << abs(estimated_leftover - actual_leftover) << std::endl;
+			}
+
+			p.leftovers.back().push_back(std::make_tuple(olb.first, estimated_leftover, actual_leftover));
+		}
+	}
+
+	return p;
+}
+
+Metrics::Metrics(std::vector<Partial> partials, const std::string& output)
+{
+	// Replay in the order of the trays, as a single run would have computed them
+	std::sort(partials.begin(), partials.end(), [](const Partial& a, const Partial& b) { return a.tray < b.tray; });
+	for (int i = 1; i < partials.size(); i++)
+		if (partials[i].tray == partials[i - 1].tray)
+			throw std::invalid_argument("Metrics: tray " + std::to_string(partials[i].tray) + " is in more than one partial");
+
 	true_positives = std::vector<double>(14, 0);							   // TP: True positives for each class							
 	false_positives = std::vector<double>(14, 0);							   // FP: False positives for each class
 	false_negatives = std::vector<double>(14, 0);							   // FN: False negatives for each class
@@ -17,86 +148,29 @@ Metrics::Metrics(std::vector<std::vector<std::tuple<cv::Mat, std::vector<std::pa
 	average_precision = std::vector<double>(14, 0);							   // Average precision for each class
 
 	// Compute mIoU
-	for (const auto& tray : metrics)
-	{	// For each 'tray' in the metrics vector
+	for (const auto& tray : partials)
+	{	// For each 'tray' in the partials
 		for (int i = 0; i < 3; i++)
 		{	// For each image [i] in the tray, except for leftover3
-			cv::Mat mask = std::get<0>(tray[i]);										     // Mask computed by segmentation
-			cv::Mat orig_mask = std::get<2>(tray[i]);									     // Mask computed by ground truth
-			std::vector<std::pair<int, cv::Rect>> labeled_box = std::get<1>(tray[i]);	     // Labels computed by segmentation
-			std::vector<std::pair<int, cv::Rect>> orig_labeled_box = std::get<3>(tray[i]);   // Labels computed by ground truth
-
-			for (const auto& olb : orig_labeled_box)
-			{	// For each label 'olb' in the ground truth
-				cv::Mat thresh_mask, thres_orig_mask;
-				cv::compare(mask, olb.first, thresh_mask, cv::CMP_EQ);
-				cv::compare(orig_mask, olb.first, thres_orig_mask, cv::CMP_EQ);
-				cv::Mat intersection = thresh_mask & thres_orig_mask;
-				cv::Mat union_ = thresh_mask | thres_orig_mask;
-
-				// Compute IoU
-				double iou = (double)cv::countNonZero(intersection) / (double)cv::countNonZero(union_);
-				IoU[olb.first].push_back(iou);
-			}
+			for (int k = 0; k < tray.labels[i].size(); k++)
+				IoU[tray.labels[i][k]].push_back(tray.iou[i][k]);
 		}
 	}
 
-	// Food leftover estimation
-	std::ofstream file;
-	file.open("./output/Food_leftover.txt");
-	file << "Food leftover estimation" << std::endl;
-	file.close();
-
-	for (int i = 0; i < metrics.size(); i++)
-	{	// For each tray [i] in the metrics vector
-		cv::Mat mask = std::get<0>(metrics[i][0]);											   // Mask computed by segmentation
-		cv::Mat orig_mask = std::get<2>(metrics[i][0]);										   // Mask computed by ground truth
-		std::vector<std::pair<int, cv::Rect>> labeled_box = std::get<1>(metrics[i][0]);		   // Labels computed by segmentation
-		std::vector<std::pair<int, cv::Rect>> orig_labeled_box = std::get<3>(metrics[i][0]);   // Labels computed by ground truth
+	// Food leftover estimation, written to file at once after all the trays
+	std::ostringstream report;
+	report << "Food leftover estimation" << std::endl;
 
+	for (int i = 0; i < partials.size(); i++)
+	{	// For each tray [i] in the partials
 		std::vector<std::vector<std::string>> food_leftover = std::vector<std::vector<std::string>>(3, std::vector<std::string>()); // Food leftover for each tray
 
-		if (DEBUG) std::cout << "Tray " << i << std::endl;
-
 		// Compute food leftover
 		for (int j = 1; j < 4; j++)
 		{	// For each image [j] in the tray, except for the first one
-			if (DEBUG) std::cout << "   Leftover " << j << std::endl;
-
-			cv::Mat mask_left = std::get<0>(metrics[i][j]);		   // Mask computed by segmentation
-			cv::Mat orig_mask_left = std::get<2>(metrics[i][j]);   // Mask computed by ground truth
-
-			// Count non zero pixels for each food type
-			for (const auto& olb : orig_labeled_box)
-			{	// For each label 'olb' in the ground truth
-				double food_pixels, orig_food_pixels;
-				double food_pixels_left, orig_food_pixels_left;
-
-				// Pixels of food in the food_tray
-				cv::Mat thresh_mask, thres_orig_mask;
-				cv::compare(mask, olb.first, thresh_mask, cv::CMP_EQ);
-				cv::compare(orig_mask, olb.first, thres_orig_mask, cv::CMP_EQ);
-				food_pixels = cv::countNonZero(thresh_mask);
-				orig_food_pixels = cv::countNonZero(thres_orig_mask);
-
-				// Pixels of food in the leftover 3
-				cv::Mat thresh_mask_left, thres_orig_mask_left;
-				cv::compare(mask_left, olb.first, thresh_mask_left, cv::CMP_EQ);
-				cv::compare(orig_mask_left, olb.first, thres_orig_mask_left, cv::CMP_EQ);
-				food_pixels_left = cv::countNonZero(thresh_mask_left);
-				orig_food_pixels_left = cv::countNonZero(thres_orig_mask_left);
-
-				// Compute estimated leftover
-				double estimated_leftover = (food_pixels_left / food_pixels);
-				double actual_leftover = (orig_food_pixels_left / orig_food_pixels);
-				if (DEBUG)
-				{
-					std::cout << "Estimated leftover of food " << olb.first << " = " << estimated_leftover << std::endl;
-					std::cout << "Actual leftover of food " << olb.first << " = " << actual_leftover << std::endl;
-					std::cout << "Difference = " << abs(estimated_leftover - actual_leftover) << std::endl;
-				}
-
-				std::string temp = "Food " + std::to_string(olb.first) + "\n" +
+			for (const auto& [label, estimated_leftover, actual_leftover] : partials[i].leftovers[j - 1])
+			{	// For each label in the ground truth
+				std::string temp = "Food " + std::to_string(label) + "\n" +
 					"      Real Leftover: " + std::to_string(actual_leftover) + "\n" +
 					"      Estimated Leftover: " + std::to_string(estimated_leftover) + "\n" +
 					"      Difference: " + std::to_string(abs(estimated_leftover - actual_leftover));
@@ -104,71 +178,54 @@ Metrics::Metrics(std::vector<std::vector<std::tuple<cv::Mat, std::vector<std::pa
 			}
 		}
 
-		// Write food leftover to file
-		std::ofstream file;
-		file.open("./output/Food_leftover.txt", std::ios_base::app);
-		file << "Tray " << i + 1 << std::endl;
+		// Add food leftover to the report
+		report << "Tray " << partials[i].tray << std::endl;
 		for (int j = 0; j < food_leftover.size(); j++)
 		{	// For each leftover image [j] in the tray
-			file << "Leftover " << j + 1 << std::endl;
+			report << "Leftover " << j + 1 << std::endl;
 			for (int k = 0; k < food_leftover[j].size(); k++)
 			{	// For each food type [k] in the leftover image
-				file << food_leftover[j][k] << std::endl;
+				report << food_leftover[j][k] << std::endl;
 			}
 		}
-		file << std::endl;
+		report << std::endl;
 	}
+	leftover_report = report.str();
 
 	// Compute mAP
 	std::vector<double> occurrency = std::vector<double>(14, 0);   // Number of occurrencies of each food type
-	for (const auto& tray : metrics)
-	{	// For each 'tray' in the metrics vector
+	for (const auto& tray : partials)
+	{	// For each 'tray' in the partials
 		for (int i = 0; i < 3; i++)
 		{	// For each image [i] in the tray except for leftover 3
-			std::vector<std::pair<int, cv::Rect>> orig_labeled_box = std::get<3>(tray[i]);   // Labels computed by ground truth
-			for (const auto& olb : orig_labeled_box)
-				occurrency[olb.first]++;
+			for (const auto label : tray.labels[i])
+				occurrency[label]++;
 		}
 	}
-	for (const auto& tray : metrics)
-	{	// For each 'tray' in the metrics vector
+	for (const auto& tray : partials)
+	{	// For each 'tray' in the partials
 		for (int i = 0; i < 3; i++)
 		{	// For each image [i] in the tray except for leftover 3
-			cv::Mat mask = std::get<0>(tray[i]);										     // Mask computed by segmentation
-			cv::Mat orig_mask = std::get<2>(tray[i]);									     // Mask computed by ground truth
-			std::vector<std::pair<int, cv::Rect>> labeled_box = std::get<1>(tray[i]);	     // Labels computed by segmentation
-			std::vector<std::pair<int, cv::Rect>> orig_labeled_box = std::get<3>(tray[i]);   // Labels computed by ground truth
-
-			for (const auto& olb : orig_labeled_box)
-			{	// For each label 'olb' in the ground truth
-
-				// Find label in computed labels
-				auto lb = std::find_if(labeled_box.begin(), labeled_box.end(), [olb](const std::pair<int, cv::Rect>& p) { return p.first == olb.first; });
-				if (lb == labeled_box.end())
-				{	// If label is not found
-					false_negatives[olb.first]++;   // Increment false negatives
-					continue;
-				}
+			const std::vector<int>& orig_labels = tray.labels[i];   // Labels computed by ground truth
 
-				cv::Rect intersection = lb->second & olb.second;				    // Compute intersection
-				cv::Rect union_ = lb->second | olb.second;						    // Compute union
-				double iou = (double)intersection.area() / (double)union_.area();   // Compute intersection over union
-
-				iou >= 0.5                            // IoU threshold
-					? true_positives[olb.first]++     // Increment true positives
-					: false_positives[olb.first]++;   // Increment false negatives
-
-				labeled_box.erase(lb);   // Remove the label from the computed labels
+			for (int k = 0; k < orig_labels.size(); k++)
+			{	// For each label [k] in the ground truth
+				switch (tray.outcomes[i][k])
+				{
+				case Partial::FALSE_NEGATIVE: false_negatives[orig_labels[k]]++; break;   // Label not found
+				case Partial::TRUE_POSITIVE:  true_positives[orig_labels[k]]++;  break;   // IoU above the threshold
+				default:                      false_positives[orig_labels[k]]++; break;   // IoU below the threshold
+				}
 			}
 
 			// False positives
-			for (const auto& lb : labeled_box)
-				false_positives[lb.first]++; // add false positives for each label 'lb' in the computed labels
+			for (const auto label : tray.unmatched[i])
+				false_positives[label]++; // add false positives for each label in the computed labels
 
 			// Compute precision and recall
-			for (int i = 0; i < orig_labeled_box.size(); i++)
-			{	// For each label [i] in the ground truth
-				int orig_label = orig_labeled_box[i].first;   // Label of the ground truth
+			for (int k = 0; k < orig_labels.size(); k++)
+			{	// For each label [k] in the ground truth
+				int orig_label = orig_labels[k];   // Label of the ground truth
 
 				(true_positives[orig_label] + false_positives[orig_label]) != 0
 					? precision[orig_label].push_back(true_positives[orig_label] / (true_positives[orig_label] + false_positives[orig_label]))
@@ -222,11 +279,17 @@ Metrics::Metrics(std::vector<std::vector<std::tuple<cv::Mat, std::vector<std::pa
 	for (int i = 1; i < 14; i++)
 		mean += average_precision[i];
 	mean /= 13.0;
+	mean_average_precision = mean;
 
 	if (DEBUG) std::cout << "mean: " << mean << std::endl;
+	if (output.empty()) return;
 
 	// Write results to file
-	file.open("./output/metrics_results.txt");
+	std::ofstream file;
+	file.open(output + "Food_leftover.txt");
+	file << leftover_report;
+	file.close();
+	file.open(output + "metrics_results.txt");
 
 	// Write mAP
 	file << "Average Precision for each class: " << std::endl;
@@ -237,19 +300,115 @@ Metrics::Metrics(std::vector<std::vector<std::tuple<cv::Mat, std::vector<std::pa
 
 	// Write mIoU
 	file << "Mean Intersection over Union for each class: " << std::endl;
+	const std::vector<double> mean_iou = getMeanIoU();
 	for (int i = 1; i < 14; i++)
 	{	// For each label [i]
-		double mean_iou = 0.0;   // Initialize mean IoU
+		if (DEBUG) std::cout << "label: " << i << " mIoU: " << mean_iou[i] << std::endl;
+
+		file << "label: " << i << " mIoU: " << mean_iou[i] << std::endl;
+	}
+	file << std::endl;
+
+	file.close();
+}
 
+std::vector<double> Metrics::getMeanIoU() const
+{
+	std::vector<double> mean_iou(CLASSES, 0.0);
+	for (int i = 1; i < CLASSES; i++)
+	{	// For each label [i]
 		for (int j = 0; j < IoU[i].size(); j++)
-			mean_iou += IoU[i][j];
-		mean_iou /= IoU[i].size();
+			mean_iou[i] += IoU[i][j];
+		mean_iou[i] /= IoU[i].size();   // NaN if the label is never in the ground truth
+	}
+	return mean_iou;
+}
 
-		if (DEBUG) std::cout << "label: " << i << " mIoU: " << mean_iou << std::endl;
+double Metrics::getMeanIoUOverall() const
+{
+	const std::vector<double> mean_iou = getMeanIoU();
+	double sum = 0.0;
+	int labels = 0;
+	for (int i = 1; i < CLASSES; i++)
+		if (!std::isnan(mean_iou[i]))
+		{
+			sum += mean_iou[i];
+			labels++;
+		}
+	return labels > 0 ? sum / labels : 0.0;
+}
 
-		file << "label: " << i << " mIoU: " << mean_iou << std::endl;
+void Metrics::save(const std::vector<Partial>& partials, const std::string& path)
+{
+	// Doubles are written with all their digits, so that the merge replays them exactly
+	cv::FileStorage fs(path, cv::FileStorage::WRITE);
+	if (!fs.isOpened()) throw std::runtime_error("Metrics: cannot write " + path);
+	fs << "trays" << "[";
+	for (const auto& p : partials)
+	{	// For each tray 'p' in the partials
+		fs << "{" << "tray" << p.tray;
+		for (int i = 0; i < p.labels.size(); i++)
+		{	// For each image [i] in the tray, except for leftover3
+			const std::string image = std::to_string(i);
+			fs << "labels" + image << p.labels[i] << "outcomes" + image << p.outcomes[i] << "unmatched" + image << p.unmatched[i] << "iou" + image << p.iou[i];
+		}
+		for (int j = 0; j < p.leftovers.size(); j++)
+		{	// For each leftover image [j] in the tray
+			std::vector<int> labels;
+			std::vector<double> estimated, actual;
+			for (const auto& [label, e, a] : p.leftovers[j])
+			{
+				labels.push_back(label);
+				estimated.push_back(e);
+				actual.push_back(a);
+			}
+			const std::string leftover = std::to_string(j + 1);
+			fs << "leftover_labels" + leftover << labels << "estimated" + leftover << estimated << "actual" + leftover << actual;
+		}
+		fs << "}";
 	}
-	file << std::endl;
+	fs << "]";
+	fs.release();
+}
 
-	file.close();
-}
\ No newline at end of file
+std::vector<Metrics::Partial> Metrics::load(const std::string& path)
+{
+	cv::FileStorage fs(path, cv::FileStorage::READ);
+	if (!fs.isOpened()) throw std::runtime_error("Metrics: cannot read " + path);
+	std::vector<Partial> partials;
+	for (const auto& node : fs["trays"])
+	{	// For each tray 'node' in the file
+		Partial p;
+		p.tray = (int)node["tray"];
+		for (int i = 0; i < 3; i++)
+		{	// For each image [i] in the tray, except for leftover3
+			const std::string image = std::to_string(i);
+			p.labels.emplace_back();
+			p.outcomes.emplace_back();
+			p.unmatched.emplace_back();
+			p.iou.emplace_back();
+			node["labels" + image] >> p.labels.back();
+			node["outcomes" + image] >> p.outcomes.back();
+			node["unmatched" + image] >> p.unmatched.back();
+			node["iou" + image] >> p.iou.back();
+			if (p.outcomes.back().size() != p.labels.back().size() || p.iou.back().size() != p.labels.back().size())
+				throw std::runtime_error("Metrics: malformed tray " + std::to_string(p.tray) + " in " + path);
+		}
+		for (int j = 1; j < 4; j++)
+		{	// For each leftover image [j] in the tray
+			const std::string leftover = std::to_string(j);
+			std::vector<int> labels;
+			std::vector<double> estimated, actual;
+			node["leftover_labels" + leftover] >> labels;
+			node["estimated" + leftover] >> estimated;
+			node["actual" + leftover] >> actual;
+			if (estimated.size() != labels.size() || actual.size() != labels.size())
+				throw std::runtime_error("Metrics: malformed tray " + std::to_string(p.tray) + " in " + path);
+			p.leftovers.emplace_back();
+			for (int k = 0; k < labels.size(); k++)
+				p.leftovers.back().push_back(std::make_tuple(labels[k], estimated[k], actual[k]));
+		}
+		partials.push_back(p);
+	}
+	return partials;
+}
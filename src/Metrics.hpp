@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+#include <tuple>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
@@ -7,14 +9,86 @@
 class Metrics
 {
 public:
+    /**
+     * @brief For each tray, for each image: <found mask, found boxes, ground truth mask, ground truth boxes>.
+     */
+    using Data = std::vector<std::vector<std::tuple<cv::Mat, std::vector<std::pair<int, cv::Rect>>, cv::Mat, std::vector<std::pair<int, cv::Rect>>>>>;
+
+    /**
+     * @brief Everything the metrics need from a tray, independent of the other trays: the partials of a subset of the trays
+     * (e.g. a shard of the dataset) are merged into exactly the metrics of a single run over all of them.
+     */
+    struct Partial
+    {
+        enum Outcome { FALSE_NEGATIVE, TRUE_POSITIVE, FALSE_POSITIVE };
+
+        int tray = 0;                                     // Number of the tray in the dataset, from 1
+        std::vector<std::vector<int>> labels;             // For each image but leftover3: labels of the ground truth boxes
+        std::vector<std::vector<int>> outcomes;           // For each image but leftover3: Outcome of each ground truth box
+        std::vector<std::vector<int>> unmatched;          // For each image but leftover3: labels of the found boxes left unmatched
+        std::vector<std::vector<double>> iou;             // For each image but leftover3: mask IoU of each ground truth label
+        std::vector<std::vector<std::tuple<int, double, double>>> leftovers;   // For each leftover: <label, estimated, actual> ratio of each food
+    };
+
     /**
      * @brief Construct a new Metrics object and calculate the metrics, as requested in the assignment.
      * @param m The vector of metrics, as computed in src\main.cpp.
+     * @param output The directory where the reports are written, none if empty.
      */
-    Metrics(std::vector<std::vector<std::tuple<cv::Mat, std::vector<std::pair<int, cv::Rect>>, cv::Mat, std::vector<std::pair<int, cv::Rect>>>>>& m);
+    Metrics(const Data& m, const std::string& output = "./output/");
+    /**
+     * @brief Construct a new Metrics object from the partials of the trays, replayed in the order of the trays.
+     * @param partials The partials, e.g. loaded from the shards of a run.
+     * @param output The directory where the reports are written, none if empty.
+     * @throws std::invalid_argument If a tray is in more than one partial.
+     */
+    Metrics(std::vector<Partial> partials, const std::string& output = "./output/");
+
+    /**
+     * @brief Compute the partial of a tray.
+     * @param tray The four images of the tray, as in Data.
+     * @param number The number of the tray in the dataset, from 1.
+     * @return The partial.
+     */
+    static Partial partial(const Data::value_type& tray, int number);
+    /**
+     * @brief Write the partials of a shard.
+     * @param partials The partials.
+     * @param path The path of the file.
+     */
+    static void save(const std::vector<Partial>& partials, const std::string& path);
+    /**
+     * @brief Read the partials of a shard.
+     * @param path The path of the file, as written by save.
+     * @return The partials.
+     * @throws std::runtime_error If the file cannot be read.
+     */
+    static std::vector<Partial> load(const std::string& path);
+
+    double getMeanAveragePrecision() const { return mean_average_precision; }
+    const std::vector<double>& getAveragePrecision() const { return average_precision; }   // By label, 1 to CLASSES - 1
+    /**
+     * @brief Mean IoU of each label over the images where it is in the ground truth.
+     * @return The mean IoU by label, 1 to CLASSES - 1, NaN for a label never in the ground truth.
+     */
+    std::vector<double> getMeanIoU() const;
+    /**
+     * @brief Mean IoU over the labels in the ground truth.
+     * @return The mIoU.
+     */
+    double getMeanIoUOverall() const;
+    const std::string& getLeftoverReport() const { return leftover_report; }
+
+    static constexpr int CLASSES = 14;   // Background and the 13 labels
 
 private:
-    const std::vector<std::vector<std::tuple<cv::Mat, std::vector<std::pair<int, cv::Rect>>, cv::Mat, std::vector<std::pair<int, cv::Rect>>>>> metrics;
+    /**
+     * @brief Partials of the trays, numbered from 1 in their order.
+     */
+    static std::vector<Partial> partials(const Data& m);
+
+    std::string leftover_report;
+    double mean_average_precision = 0.0;
     std::vector<double> false_positives;
     std::vector<double> false_negatives;
     std::vector<double> true_positives;
@@ -0,0 +1,131 @@
+#include "Morphology.hpp"
+
+#include <algorithm>
+
+#define DEBUG false
+
+Morphology::Morphology(const BitMask& in, const std::vector<std::pair<Operation, cv::Mat>>& chain)
+	: result(in.getRows(), in.getCols()), rows(in.getRows()), words(in.getWords()),
+	last(in.getCols() % 64 ? (uint64_t(1) << (in.getCols() % 64)) - 1 : ~uint64_t(0)), run(in.getWords()), scratch(in.getWords())
+{
+	// Stages: the structuring elements as horizontal runs, with the anchor in the center like cv::morphologyEx
+	std::vector<Stage> stages;
+	for (const auto& [operation, kernel] : chain)
+	{
+		Stage stage;
+		stage.operation = operation;
+		stage.height = kernel.rows;
+		stage.anchor = kernel.rows / 2;
+		for (int i = 0; i < kernel.rows; i++)
+		{
+			const uchar* k = kernel.ptr<uchar>(i);
+			for (int j = 0; j < kernel.cols; j++)
+			{
+				if (!k[j] || (j > 0 && k[j - 1])) continue;
+				int length = 0;
+				while (j + length < kernel.cols && k[j + length]) length++;
+				stage.runs.push_back({ i, j - kernel.cols / 2, length });
+			}
+		}
+		stage.ring.assign(size_t(stage.height) * words, 0);
+		stage.output.assign(words, 0);
+		stages.push_back(std::move(stage));
+	}
+	if (words == 0) return;
+
+	// Stream the rows, then flush the stages in order: their last rows have part of the window past the bottom
+	for (int y = 0; y < rows; y++)
+		push(stages, 0, in.row(y));
+	for (size_t s = 0; s < stages.size(); s++)
+		while (stages[s].emitted < rows)
+		{
+			emit(stages[s]);
+			push(stages, s + 1, stages[s].output.data());
+		}
+}
+
+void Morphology::push(std::vector<Stage>& stages, size_t s, const uint64_t* row)
+{
+	if (s == stages.size())
+	{	// Output of the chain
+		std::copy(row, row + words, result.row(written++));
+		return;
+	}
+
+	// An erosion is the dilation of the complement, with the rows and columns outside the mask set instead of cleared
+	Stage& stage = stages[s];
+	uint64_t* slot = &stage.ring[size_t(stage.received % stage.height) * words];
+	for (int w = 0; w < words; w++)
+		slot[w] = stage.operation == ERODE ? ~row[w] : row[w];
+	slot[words - 1] &= last;
+	stage.received++;
+
+	// Emit the rows whose window is complete
+	const int below = stage.height - 1 - stage.anchor;
+	while (stage.emitted + below < stage.received)
+	{
+		emit(stage);
+		push(stages, s + 1, stage.output.data());
+	}
+}
+
+void Morphology::emit(Stage& stage)
+{
+	const int y = stage.emitted++;
+	std::fill(stage.output.begin(), stage.output.end(), 0);
+	for (const auto& r : stage.runs)
+	{
+		const int source = y + r.row - stage.anchor;
+		if (source < 0 || source >= rows) continue;   // Outside rows never contribute to a dilation
+		const uint64_t* row = &stage.ring[size_t(source % stage.height) * words];
+
+		// Columns right and left of the anchor apart, so that no shift drops bits that are still needed
+		const int first = r.offset, end = r.offset + r.length - 1;
+		if (end >= 0) spread(row, std::max(first, 0), end, stage.output.data());
+		if (first < 0) spread(row, first, std::min(end, -1), stage.output.data());
+	}
+	if (stage.operation == ERODE)
+		for (auto& word : stage.output) word = ~word;
+	stage.output[words - 1] &= last;
+}
+
+void Morphology::spread(const uint64_t* row, int from, int to, uint64_t* out)
+{
+	// OR of the columns x + from ... x + to by doubling, from the anchor side of the range outwards
+	const int direction = from >= 0 ? 1 : -1;
+	const int length = to - from + 1;
+	std::copy(row, row + words, run.begin());
+	int covered = 1;
+	for (; 2 * covered <= length; covered *= 2)
+	{
+		shift(run.data(), scratch.data(), direction * covered);
+		for (int w = 0; w < words; w++) run[w] |= scratch[w];
+	}
+	if (covered < length)
+	{
+		shift(run.data(), scratch.data(), direction * (length - covered));
+		for (int w = 0; w < words; w++) run[w] |= scratch[w];
+	}
+
+	// Moved to the end of the range nearest to the anchor
+	shift(run.data(), scratch.data(), direction > 0 ? from : to);
+	for (int w = 0; w < words; w++) out[w] |= scratch[w];
+}
+
+void Morphology::shift(const uint64_t* src, uint64_t* dst, int k) const
+{
+	const int q = std::abs(k) / 64, r = std::abs(k) % 64;
+	for (int w = 0; w < words; w++)
+	{
+		if (k >= 0)
+		{	// Higher columns move down
+			const uint64_t lo = w + q < words ? src[w + q] : 0, hi = w + q + 1 < words ? src[w + q + 1] : 0;
+			dst[w] = r ? (lo >> r) | (hi << (64 - r)) : lo;
+		}
+		else
+		{	// Lower columns move up
+			const uint64_t hi = w - q >= 0 ? src[w - q] : 0, lo = w - q - 1 >= 0 ? src[w - q - 1] : 0;
+			dst[w] = r ? (hi << r) | (lo >> (64 - r)) : hi;
+		}
+	}
+}
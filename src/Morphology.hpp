@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "BitMask.hpp"
+
+class Morphology
+{
+public:
+	enum Operation { DILATE, ERODE };
+
+	/**
+	 * @brief Construct a new Morphology object, running a chain of dilations and erosions on a packed mask in a single streaming pass.
+	 * Rows flow through the stages one at a time: each stage only keeps the rows under its kernel, so the whole chain works on a few
+	 * kilobytes instead of writing a full intermediate mask per operation. Results and borders are the ones of cv::dilate and cv::erode.
+	 * @param in The packed mask.
+	 * @param chain The operations, in order, with their structuring elements (centered anchor).
+	 */
+	Morphology(const BitMask& in, const std::vector<std::pair<Operation, cv::Mat>>& chain);
+
+	const BitMask& getResult() const { return result; }
+
+private:
+	struct Run
+	{
+		int row;          // Row of the structuring element
+		int offset;       // Column offset of the first element of the run, relative to the anchor
+		int length;       // Number of elements
+	};
+	struct Stage
+	{
+		Operation operation;
+		int height, anchor;              // Rows of the structuring element and row of its anchor
+		std::vector<Run> runs;           // Horizontal runs of the structuring element
+		std::vector<uint64_t> ring;      // Last height input rows, complemented for an erosion
+		std::vector<uint64_t> output;    // Row being emitted
+		int received = 0, emitted = 0;   // Input rows received and output rows emitted
+	};
+
+	BitMask result;
+	int rows, words;
+	int written = 0;                     // Rows of the result
+	uint64_t last;                       // Valid bits of the last word of a row
+	std::vector<uint64_t> run, scratch;  // Row buffers of the horizontal runs
+
+	/**
+	 * @brief Feed an input row to a stage, emitting to the next one the output rows whose window is complete.
+	 * @param stages The stages.
+	 * @param s The index of the stage, the result if past the last one.
+	 * @param row The row.
+	 */
+	void push(std::vector<Stage>& stages, size_t s, const uint64_t* row);
+	/**
+	 * @brief Emit the next output row of a stage: the OR of its runs over the rows in the window, outside rows excluded.
+	 * @param stage The stage.
+	 */
+	void emit(Stage& stage);
+	/**
+	 * @brief OR into a row the input row spread over a range of column offsets, all on the same side of the anchor.
+	 * @param row The input row.
+	 * @param from The first offset.
+	 * @param to The last offset.
+	 * @param out The row to OR into.
+	 */
+	void spread(const uint64_t* row, int from, int to, uint64_t* out);
+	/**
+	 * @brief Shift a row so that column x takes the value of column x + k, zero past the ends.
+	 */
+	void shift(const uint64_t* src, uint64_t* dst, int k) const;
+};
@@ -0,0 +1,127 @@
+#include "Profiler.hpp"
+
+#include "Utils.hpp"
+
+#include <cstdint>
+#include <cstdio>
+
+#include <opencv2/opencv.hpp>
+
+#define DEBUG false
+
+namespace
+{
+	/**
+	 * @brief Allocator of the cv::Mat buffers, which bypass operator new: counts and delegates to the standard one.
+	 */
+	class CountingAllocator : public cv::MatAllocator
+	{
+	public:
+		cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+		{
+			cv::UMatData* u = cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage);
+			u->currAllocator = this;   // So that the release comes back here
+			const int stage = data ? -1 : Profiler::allocated(u->size);   // User data is not owned
+			u->userdata = reinterpret_cast<void*>(intptr_t(stage + 1));
+			return u;
+		}
+		bool allocate(cv::UMatData* u, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+		{
+			return cv::Mat::getStdAllocator()->allocate(u, flags, usage);
+		}
+		void deallocate(cv::UMatData* u) const override
+		{
+			Profiler::released(int(reinterpret_cast<intptr_t>(u->userdata)) - 1, u->size);
+			u->userdata = nullptr;
+			cv::Mat::getStdAllocator()->deallocate(u);
+		}
+	};
+}
+
+std::atomic<bool> Profiler::enabled{ false };
+Profiler::Counters Profiler::counters[Profiler::STAGES];
+thread_local Profiler::Stage Profiler::current = Profiler::OTHER;
+std::atomic<long long> Profiler::heap{ 0 };
+
+void Profiler::enable()
+{
+	static CountingAllocator allocator;
+	cv::Mat::setDefaultAllocator(&allocator);
+	enabled = true;
+}
+
+Profiler::Scope::Scope(Stage s)
+	: previous(current)
+{
+	if (isEnabled()) sample();
+	current = s;
+	if (isEnabled()) sample();
+}
+
+Profiler::Scope::~Scope()
+{
+	if (isEnabled()) sample();
+	current = previous;
+}
+
+int Profiler::allocated(size_t bytes)
+{
+	if (!isEnabled()) return -1;
+	Counters& c = counters[current];
+	c.allocations.fetch_add(1, std::memory_order_relaxed);
+	c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	const long long live = c.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	long long peak = c.peak.load(std::memory_order_relaxed);
+	while (live > peak && !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+	return current;
+}
+
+void Profiler::released(int stage, size_t bytes)
+{
+	if (stage >= 0) counters[stage].live.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void Profiler::allocatedBlock(size_t bytes)
+{
+	if (!isEnabled()) return;
+	Counters& c = counters[current];
+	c.allocations.fetch_add(1, std::memory_order_relaxed);
+	c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	const long long live = heap.fetch_add(bytes, std::memory_order_relaxed) + bytes + c.live.load(std::memory_order_relaxed);
+	long long peak = c.peak.load(std::memory_order_relaxed);
+	while (live > peak && !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+}
+
+void Profiler::releasedBlock(size_t bytes)
+{
+	if (isEnabled()) heap.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void Profiler::sample()
+{
+	const size_t rss = utils::residentMemory();
+	Counters& c = counters[current];
+	size_t peak = c.rss.load(std::memory_order_relaxed);
+	while (rss > peak && !c.rss.compare_exchange_weak(peak, rss, std::memory_order_relaxed));
+}
+
+std::string Profiler::checkpoint(const std::string& name)
+{
+	auto mb = [](double bytes) -> double { return bytes / (1024.0 * 1024.0); };
+
+	char line[256];
+	std::snprintf(line, sizeof(line), " (RSS %.1f MB)\n", mb(utils::residentMemory()));
+	std::string summary = name + line;
+	for (int s = 0; s < STAGES; s++)
+	{
+		Counters& c = counters[s];
+		const size_t allocations = c.allocations.exchange(0);
+		const size_t bytes = c.bytes.exchange(0);
+		const long long peak = c.peak.exchange(c.live.load());
+		const size_t rss = c.rss.exchange(0);
+		if (allocations == 0 && rss == 0) continue;
+		std::snprintf(line, sizeof(line), "    %-14s%10zu allocations %10.1f MB allocated %8.1f MB peak live %8.1f MB peak RSS\n", NAMES[s], allocations, mb(bytes), mb(peak), mb(rss));
+		summary += line;
+	}
+	return summary;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+class Profiler
+{
+public:
+	/**
+	 * @brief Stages the allocations are attributed to.
+	 */
+	enum Stage { OTHER, BOUNDING_BOXES, CLIP, SEGMENTATION, SALAD, BREAD, METRICS, OUTPUT, STAGES };
+
+	/**
+	 * @brief Start counting: installs the counting cv::MatAllocator and enables the operator new hook, if linked (ProfilerHook.cpp,
+	 * CMake option PROFILE_HEAP, CLI only). Meant to be called once, at startup.
+	 */
+	static void enable();
+	static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Scope of a stage: the allocations of the calling thread are attributed to it until the scope ends, and the RSS is sampled at its boundaries.
+	 */
+	class Scope
+	{
+	public:
+		Scope(Stage s);
+		~Scope();
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	private:
+		Stage previous;   // Stage of the thread before the scope
+	};
+
+	/**
+	 * @brief Summary of the allocations since the previous checkpoint, then reset the counters.
+	 * @param name The name of the unit of work since the previous checkpoint (e.g. the image).
+	 * @return One line per stage that allocated: allocations, bytes, peak live bytes and peak RSS.
+	 */
+	static std::string checkpoint(const std::string& name);
+
+	/**
+	 * @brief Count an allocation of the current stage, used by the hooks.
+	 * @param bytes The size of the allocation.
+	 * @return The stage the allocation is attributed to, -1 if not counted.
+	 */
+	static int allocated(size_t bytes);
+	/**
+	 * @brief Count a deallocation, used by the hooks.
+	 * @param stage The stage the allocation was attributed to.
+	 * @param bytes The size of the allocation.
+	 */
+	static void released(int stage, size_t bytes);
+	/**
+	 * @brief Count an operator new block, used by the optional hook: attributed to the current stage, with the process-wide live bytes
+	 * of the blocks added to the peak live of the stage.
+	 * @param bytes The usable size of the block.
+	 */
+	static void allocatedBlock(size_t bytes);
+	/**
+	 * @brief Count the release of an operator new block, used by the optional hook. The stage of a block is not kept with it,
+	 * so that a block allocated outside of the hook (e.g. by a DLL) is released like any other.
+	 * @param bytes The usable size of the block.
+	 */
+	static void releasedBlock(size_t bytes);
+
+private:
+	struct Counters
+	{
+		std::atomic<size_t> allocations{ 0 };   // Number of allocations since the last checkpoint
+		std::atomic<size_t> bytes{ 0 };         // Bytes allocated since the last checkpoint
+		std::atomic<long long> live{ 0 };       // Bytes currently allocated
+		std::atomic<long long> peak{ 0 };       // Peak of live since the last checkpoint
+		std::atomic<size_t> rss{ 0 };           // Peak RSS sampled at the boundaries of the stage since the last checkpoint
+	};
+
+	static std::atomic<bool> enabled;
+	static Counters counters[STAGES];
+	static thread_local Stage current;
+	static std::atomic<long long> heap;   // Live bytes of the operator new blocks since enabled, negative if more were released than counted
+	static constexpr const char* NAMES[STAGES] = { "other", "BoundingBoxes", "CLIP", "Segmentation", "salad", "bread", "Metrics", "output" };
+
+	/**
+	 * @brief Update the peak RSS of the current stage.
+	 */
+	static void sample();
+};
@@ -0,0 +1,48 @@
+// Global operator new hook of the memory profiler, linked into the CLI only (CMake option PROFILE_HEAP):
+// libraries embedding FoodCore keep their own allocator. The blocks carry no header, their usable size is asked to the
+// allocator instead, so that a block allocated elsewhere (e.g. inside the OpenCV DLL) is freed as it is.
+
+#include "Profiler.hpp"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#define USABLE_SIZE(p) _msize(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define USABLE_SIZE(p) malloc_size(p)
+#else
+#include <malloc.h>
+#define USABLE_SIZE(p) malloc_usable_size(p)
+#endif
+
+namespace
+{
+	void* allocate(size_t size) noexcept
+	{
+		void* p = std::malloc(size ? size : 1);
+		if (p && Profiler::isEnabled()) Profiler::allocatedBlock(USABLE_SIZE(p));
+		return p;
+	}
+
+	void release(void* p) noexcept
+	{
+		if (!p) return;
+		if (Profiler::isEnabled()) Profiler::releasedBlock(USABLE_SIZE(p));
+		std::free(p);
+	}
+}
+
+// The aligned variants are left to the default implementation
+void* operator new(size_t size) { if (void* p = allocate(size)) return p; throw std::bad_alloc(); }
+void* operator new[](size_t size) { if (void* p = allocate(size)) return p; throw std::bad_alloc(); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
@@ -1,10 +1,119 @@
 import torch
 import clip
 import os
+import json
+import mmap
+import struct
+import atexit
+from collections import OrderedDict
 from PIL import Image
 
 DEBUG = False
 
+# inference precision on cpu: "fp32", "int8" (dynamic quantization of the linear layers) or "bf16" (autocast, if the cpu supports it)
+PRECISION = os.environ.get("CLIP_PRECISION", "fp32")
+
+# embedding cache: normalized image features of the crops already seen, keyed by their perceptual hash
+CACHE_SIZE = int(os.environ.get("CLIP_CACHE_SIZE", "4096"))   # max number of entries, least recently used evicted first
+CACHE_PATH = os.environ.get("CLIP_CACHE_PATH", "")            # file where the cache persists between runs, none if empty
+embeddings = OrderedDict()
+hits, misses = 0, 0
+
+# flat copy of the weights (safetensors layout), mapped copy-on-write so that the processes of a host share its pages, none if empty
+WEIGHTS_PATH = os.environ.get("CLIP_WEIGHTS_PATH", "./ViT-B-32.safetensors")
+DTYPES = { "F32": torch.float32, "F16": torch.float16, "BF16": torch.bfloat16, "I64": torch.int64 }
+weights_mapping = None   # kept alive as long as the model uses it
+
+# intra-op threads of this interpreter, from the thread budget of the pipeline, the torch default if 0
+THREADS = int(os.environ.get("CLIP_THREADS", "0"))
+
+def dhash(image, size = 8):
+    # difference hash: sign of the horizontal gradient of the downscaled grayscale image
+    gray = image.convert("L").resize((size + 1, size), Image.LANCZOS)
+    pixels = list(gray.getdata())
+    bits = 0
+    for row in range(size):
+        for col in range(size):
+            bits = (bits << 1) | (pixels[row * (size + 1) + col] > pixels[row * (size + 1) + col + 1])
+    return "%s:%016x" % (PRECISION, bits)
+
+def load_cache():
+    global embeddings
+
+    if CACHE_PATH and os.path.exists(CACHE_PATH):
+        embeddings = OrderedDict(torch.load(CACHE_PATH))
+        while len(embeddings) > CACHE_SIZE: embeddings.popitem(last=False)
+
+def save_cache():
+    if CACHE_PATH and len(embeddings) > 0:
+        torch.save(dict(embeddings), CACHE_PATH)
+
+def cache_stats():
+    return { "hits": hits, "misses": misses, "size": len(embeddings), "capacity": CACHE_SIZE }
+
+@atexit.register
+def report():
+    save_cache()
+    if hits + misses > 0:
+        print('CLIP cache: %d hits, %d misses (%.1f%%), %d/%d entries' % (hits, misses, 100.0 * hits / (hits + misses), len(embeddings), CACHE_SIZE))
+
+def save_weights(model, path):
+    # 8 bytes header length, json header of dtype, shape and offsets, then the raw tensors: the safetensors layout
+    state = { name: tensor.detach().cpu().contiguous() for name, tensor in model.state_dict().items() }
+    names = { dtype: name for name, dtype in DTYPES.items() }
+    header, offset = {}, 0
+    for name, tensor in state.items():
+        size = tensor.numel() * tensor.element_size()
+        header[name] = { "dtype": names[tensor.dtype], "shape": list(tensor.shape), "data_offsets": [offset, offset + size] }
+        offset += size
+    data = json.dumps(header).encode()
+    data += b" " * (-len(data) % 8)
+
+    # written aside under a name of this process and renamed, so that concurrent workers neither map nor interleave a partial file
+    tmp = "%s.%d.tmp" % (path, os.getpid())
+    with open(tmp, "wb") as f:
+        f.write(struct.pack("<Q", len(data)))
+        f.write(data)
+        for tensor in state.values():
+            f.write(tensor.reshape(-1).view(torch.uint8).numpy().tobytes())
+    os.replace(tmp, path)
+
+def map_weights(path):
+    # model whose parameters point into the mapping of the file: no parse and no copy, pages are read on demand
+    global weights_mapping
+
+    with open(path, "rb") as f:
+        weights_mapping = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_COPY)
+    length = struct.unpack_from("<Q", weights_mapping, 0)[0]
+    header = json.loads(bytes(weights_mapping[8:8 + length]))
+    state = {}
+    for name, info in header.items():
+        if name == "__metadata__": continue
+        dtype = DTYPES[info["dtype"]]
+        begin, end = info["data_offsets"]
+        count = (end - begin) // torch.tensor([], dtype=dtype).element_size()
+        state[name] = torch.frombuffer(weights_mapping, dtype=dtype, count=count, offset=8 + length + begin).view(info["shape"])
+
+    # same hyperparameters as clip.model.build_model, on the meta device so that nothing is allocated before the assignment
+    vision_width = state["visual.conv1.weight"].shape[0]
+    vision_layers = len([k for k in state if k.startswith("visual.") and k.endswith(".attn.in_proj_weight")])
+    vision_patch_size = state["visual.conv1.weight"].shape[-1]
+    grid_size = round((state["visual.positional_embedding"].shape[0] - 1) ** 0.5)
+    transformer_width = state["ln_final.weight"].shape[0]
+    with torch.device("meta"):
+        model = clip.model.CLIP(
+            state["text_projection"].shape[1], vision_patch_size * grid_size, vision_layers, vision_width, vision_patch_size,
+            state["positional_embedding"].shape[0], state["token_embedding.weight"].shape[0], transformer_width, transformer_width // 64,
+            len(set(k.split(".")[2] for k in state if k.startswith("transformer.resblocks"))))
+    model.load_state_dict(state, assign=True)
+
+    # the causal mask of the text encoder is a plain attribute, not a weight: rebuilt off the meta device
+    mask = model.build_attention_mask()
+    for block in model.transformer.resblocks:
+        block.attn_mask = mask
+
+    return model.eval(), clip.clip._transform(model.visual.input_resolution)
+
 def constrained(values, indices):
     if len(indices) < 2:
         return values, indices
@@ -49,16 +158,30 @@ def constrained(values, indices):
     return v, i
 
 def process_image(img, labels):
-    global device, model, preprocess
+    pil = Image.open(img)
+    return process_features(dhash(pil), lambda: preprocess(pil).unsqueeze(0), labels)
+
+def process_features(key, tensor, labels):
+    # key of the crop in the embedding cache, and a function returning its preprocessed 1x3x224x224 tensor, called only on a miss
+    global device, model, bf16, hits, misses
 
-    image = preprocess(Image.open(img)).unsqueeze(0).to(device)
     text = clip.tokenize(labels).to(device)
 
-    with torch.no_grad():
-        image_features = model.encode_image(image)
-        text_features = model.encode_text(text)
+    with torch.no_grad(), torch.autocast("cpu", dtype=torch.bfloat16, enabled=bf16):
+        if key in embeddings:
+            # same or near identical crop already encoded
+            hits += 1
+            embeddings.move_to_end(key)
+            image_features = embeddings[key].to(device)
+        else:
+            misses += 1
+            image = tensor().to(device)
+            image_features = model.encode_image(image).float()
+            image_features /= image_features.norm(dim=-1, keepdim=True)
+            embeddings[key] = image_features.cpu()
+            if len(embeddings) > CACHE_SIZE: embeddings.popitem(last=False)
+        text_features = model.encode_text(text).float()
     
-    image_features /= image_features.norm(dim=-1, keepdim=True)
     text_features /= text_features.norm(dim=-1, keepdim=True)
     similarity = (100.0 * image_features @ text_features.T).softmax(dim=-1)
     
@@ -137,38 +260,95 @@ def process_tray(tray, labels):
                     print('        ',labels[indices[j]], values[j].item())
                 print()
 
+LABELS = [
+    "pasta with pesto",
+    "pasta with tomato sauce",
+    "pasta with meat sauce",
+    "pasta with shelled clams or mussels",
+    "pilaw rice with peppers and peas",
+    "pork meat slices or thin pork chop slices or pork loin roast slices",
+    "fish cutlet",
+    "roasted rabbit and bones",
+    "cuttlefish food",
+    "light brown beans",
+    "potatoes or basil potatoes or smashed potatoes or boiled potatoes or potato salad",
+    "empty plate"
+]
+
+model = None
+bf16 = False
+
 # the first run of this script will download the model
 
+def load():
+
+    global device, model, preprocess, bf16
+
+    if model is None:
+        if THREADS > 0: torch.set_num_threads(THREADS)
+        device = "cuda" if torch.cuda.is_available() else "cpu"
+        if device == "cpu" and WEIGHTS_PATH and os.path.exists(WEIGHTS_PATH):
+            model, preprocess = map_weights(WEIGHTS_PATH)
+        else:
+            model, preprocess = clip.load("ViT-B/32", device=device)
+            if device == "cpu" and WEIGHTS_PATH: save_weights(model, WEIGHTS_PATH)   # parsed once, mapped by the next processes
+        bf16 = False
+        load_cache()
+
+        if device == "cpu" and PRECISION == "int8":
+            model = torch.quantization.quantize_dynamic(model, {torch.nn.Linear}, dtype=torch.qint8, inplace=True)   # the other weights stay mapped
+        elif device == "cpu" and PRECISION == "bf16":
+            try:
+                bf16 = torch.ops.mkldnn._is_mkldnn_bf16_supported()
+            except (AttributeError, RuntimeError):
+                bf16 = False
+            if not bf16: print("CLIP: bf16 not supported by this cpu, using fp32")
+
 def plates( i : int = None ):
 
-    global device, model, preprocess, input_folder, output_folder
+    global input_folder, output_folder
 
     input_folder = './plates/'
     output_folder = './labels/'
 
-    labels = [
-        "pasta with pesto",
-        "pasta with tomato sauce",
-        "pasta with meat sauce",
-        "pasta with shelled clams or mussels",
-        "pilaw rice with peppers and peas",
-        "pork meat slices or thin pork chop slices or pork loin roast slices",
-        "fish cutlet",
-        "roasted rabbit and bones",
-        "cuttlefish food",
-        "light brown beans",
-        "potatoes or basil potatoes or smashed potatoes or boiled potatoes or potato salad",
-        "empty plate"
-    ]
-
-    device = "cuda" if torch.cuda.is_available() else "cpu"
-    model, preprocess = clip.load("ViT-B/32", device=device)
+    load()
 
     if i is None:
         for tray in os.listdir(input_folder):
-            process_tray(tray, labels)
+            process_tray(tray, LABELS)
+    else:
+        process_tray("tray"+str(i), LABELS)
+
+# label a single plate cutout in memory, used by the C++ Classifier
+# data is the float32 1x3x224x224 tensor preprocessed in C++, shared without copy and only valid during the call, key its hash
+
+def classify( data : memoryview, key : str, candidates : list = [] ):
+
+    tensor = lambda: torch.frombuffer(data, dtype=torch.float32).view(1, 3, 224, 224)
+    labels, scores = label("%s:%s" % (PRECISION, key), tensor, candidates)
+
+    return labels
+
+# labels and their scores of a preprocessed plate, shared by the in-process Classifier and the CLIP_worker processes
+
+def label( key : str, tensor, candidates : list = [] ):
+
+    load()
+
+    # restrict to the candidates, like the leftovers of a tray
+    if len(candidates) > 0:
+        labels = [LABELS[c-1] for c in candidates]
+        if "empty plate" not in labels: labels.append("empty plate")
     else:
-        process_tray("tray"+str(i), labels)
+        labels = LABELS
+
+    values, indices = process_features(key, tensor, labels)
+
+    indices = [LABELS.index(labels[indices[i]]) for i in range(len(indices))]
+
+    values, indices = constrained(values, indices)
+
+    return [index+1 for index in indices], [float(value) for value in values]
 
 if __name__ == "__main__":
     plates()
\ No newline at end of file
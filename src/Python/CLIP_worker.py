@@ -0,0 +1,69 @@
+# CLIP inference worker, started by the C++ Workers pool: it loads the model once and serves one slot of the shared memory
+#
+# Usage: CLIP_worker.py <shared memory name> <slot index> <slot size>
+#
+# Slot layout (little endian): state u32 at 0, candidates count u32 at 8, labels count u32 at 12, candidates i32[16] at 32,
+# labels i32[16] at 96, scores f32[16] at 160, cache key char[32] at 224, float32 1x3x224x224 tensor at 256
+
+import sys
+import time
+import struct
+import torch
+
+import CLIP_interface
+
+IDLE, REQUEST, DONE, STOP, STARTING = 0, 1, 2, 3, 4
+HEADER = 256
+MAX_LABELS = 16
+SIZE = 224
+POLL = 0.0005   # seconds between two checks of an idle slot
+
+def attach(name, size):
+    if sys.platform == "win32":
+        import mmap
+        return mmap.mmap(-1, size, tagname=name)
+    from multiprocessing import shared_memory, resource_tracker
+    shm = shared_memory.SharedMemory(name=name)
+    resource_tracker.unregister(shm._name, "shared_memory")   # the segment belongs to the C++ pool, it must survive the worker
+    return shm
+
+def main():
+    name, index, slot_size = sys.argv[1], int(sys.argv[2]), int(sys.argv[3])
+
+    # workers share the cache file with nobody: each keeps its embeddings in memory only
+    CLIP_interface.CACHE_PATH = ""
+    CLIP_interface.load()
+
+    mapping = attach(name, (index + 1) * slot_size)
+    memory = mapping.buf if hasattr(mapping, "buf") else memoryview(mapping)
+    slot = memory[index * slot_size:(index + 1) * slot_size]
+    state = lambda: struct.unpack_from("<I", slot, 0)[0]
+
+    if state() == STARTING: struct.pack_into("<I", slot, 0, IDLE)
+
+    while True:
+        s = state()
+        if s == STOP: break
+        if s != REQUEST:
+            time.sleep(POLL)
+            continue
+
+        count = struct.unpack_from("<I", slot, 8)[0]
+        candidates = list(struct.unpack_from("<%di" % count, slot, 32))
+        key = bytes(slot[224:256]).split(b"\0")[0].decode()
+        tensor = lambda: torch.frombuffer(slot[HEADER:HEADER + 3 * SIZE * SIZE * 4], dtype=torch.float32).view(1, 3, SIZE, SIZE)
+
+        labels, scores = CLIP_interface.label("%s:%s" % (CLIP_interface.PRECISION, key), tensor, candidates)
+        labels, scores = labels[:MAX_LABELS], scores[:MAX_LABELS]
+
+        # results first, state last: the pool reads them once it sees DONE
+        struct.pack_into("<I", slot, 12, len(labels))
+        struct.pack_into("<%di" % len(labels), slot, 96, *labels)
+        struct.pack_into("<%df" % len(scores), slot, 160, *scores)
+        struct.pack_into("<I", slot, 0, DONE)
+
+    del slot, memory
+    mapping.close()
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,47 @@
+# Validation of the reduced precision modes of CLIP_interface.py:
+# labels every plate cutout in ./plates/ (written by the main program) with each precision
+# and checks that the constrained() decisions are the same as in fp32.
+#
+# Usage: python Python/validate_precision.py [modes...]   (default: int8 bf16), from the working directory of the main program
+
+import os
+import sys
+import time
+
+import CLIP_interface
+
+def run(mode):
+    CLIP_interface.PRECISION = mode
+    CLIP_interface.model = None
+    CLIP_interface.load()
+    CLIP_interface.input_folder = './plates/'
+    CLIP_interface.output_folder = './labels_' + mode + '/'
+
+    start = time.perf_counter()
+    for tray in sorted(os.listdir(CLIP_interface.input_folder)):
+        CLIP_interface.process_tray(tray, CLIP_interface.LABELS)
+    elapsed = time.perf_counter() - start
+
+    labels = {}
+    for root, _, files in os.walk(CLIP_interface.output_folder):
+        for file in files:
+            with open(os.path.join(root, file)) as f:
+                labels[os.path.relpath(os.path.join(root, file), CLIP_interface.output_folder)] = f.read().split()
+    return labels, elapsed
+
+if __name__ == "__main__":
+    modes = sys.argv[1:] if len(sys.argv) > 1 else ["int8", "bf16"]
+
+    reference, reference_time = run("fp32")
+    print('fp32: %d plates, %.2f s' % (len(reference), reference_time))
+
+    failed = False
+    for mode in modes:
+        labels, elapsed = run(mode)
+        changed = [plate for plate in reference if labels.get(plate) != reference[plate]]
+        print('%s: %d plates, %.2f s (%.2fx), %d changed' % (mode, len(labels), elapsed, reference_time / elapsed, len(changed)))
+        for plate in sorted(changed):
+            print('    ', plate, reference[plate], '->', labels.get(plate))
+        failed = failed or len(changed) > 0
+
+    sys.exit(1 if failed else 0)
@@ -0,0 +1,59 @@
+# Validation of the C++ preprocessing of Classifier::preprocess (OpenCV area resize) against the PIL preprocessing of CLIP:
+# labels every plate cutout in ./plates/ (written by the main program) from both tensors
+# and checks that the constrained() decisions are the same.
+# The C++ preprocessing is replicated here with cv2, the same OpenCV calls of the C++ build.
+#
+# Usage: python Python/validate_preprocess.py   from the working directory of the main program
+
+import math
+import os
+import sys
+
+import cv2
+import numpy as np
+import torch
+from PIL import Image
+
+import CLIP_interface
+
+INPUT_SIZE = 224
+MEAN = np.array([0.48145466, 0.4578275, 0.40821073], dtype=np.float32)
+STD = np.array([0.26862954, 0.26130258, 0.27577711], dtype=np.float32)
+
+def preprocess(path):
+    # same steps as Classifier::preprocess: shorter side to INPUT_SIZE, center crop, RGB planes, (v / 255 - mean) / std
+    image = cv2.imread(path)
+    rows, cols = image.shape[:2]
+    factor = INPUT_SIZE / min(cols, rows)
+    size = (max(INPUT_SIZE, int(cols * factor)), max(INPUT_SIZE, int(rows * factor)))
+    resized = cv2.resize(image, size, interpolation=cv2.INTER_AREA if factor < 1 else cv2.INTER_CUBIC)
+    x, y = math.floor((size[0] - INPUT_SIZE) / 2.0 + 0.5), math.floor((size[1] - INPUT_SIZE) / 2.0 + 0.5)
+    crop = resized[y:y + INPUT_SIZE, x:x + INPUT_SIZE, ::-1].astype(np.float32)
+    scale, offset = 1.0 / (255.0 * STD), -MEAN / STD
+    planes = crop * scale.astype(np.float32) + offset.astype(np.float32)
+    return torch.from_numpy(np.ascontiguousarray(planes.transpose(2, 0, 1))).unsqueeze(0)
+
+if __name__ == "__main__":
+    CLIP_interface.load()
+    folder = './plates/'
+
+    plates, changed, difference = 0, [], 0.0
+    for root, _, files in os.walk(folder):
+        for file in sorted(files):
+            path = os.path.join(root, file)
+            pil = CLIP_interface.preprocess(Image.open(path)).unsqueeze(0)
+            opencv = preprocess(path)
+            difference = max(difference, (pil - opencv).abs().max().item())
+
+            # distinct keys, so that neither tensor is answered from the embedding cache of the other
+            reference, _ = CLIP_interface.label("pil:" + path, lambda: pil)
+            labels, _ = CLIP_interface.label("opencv:" + path, lambda: opencv)
+            plates += 1
+            if labels != reference:
+                changed.append((os.path.relpath(path, folder), reference, labels))
+
+    print('%d plates, %d changed, max tensor difference %.4f' % (plates, len(changed), difference))
+    for plate, reference, labels in sorted(changed):
+        print('    ', plate, reference, '->', labels)
+
+    sys.exit(1 if changed else 0)
@@ -0,0 +1,81 @@
+#include "Resources.hpp"
+
+#include "BoundingBoxes.hpp"
+#include "Segmentation.hpp"
+#include "Tray.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+Resources::Resources(double s)
+	: scale(s)
+{
+	auto gamma_lut = [](double gamma) -> cv::Mat
+	{
+		cv::Mat lookUpTable(1, 256, CV_8U);
+		uchar* p = lookUpTable.ptr();
+		for (int i = 0; i < 256; ++i)
+			p[i] = cv::saturate_cast<uchar>(pow(i / 255.0, gamma) * 255.0);
+		return lookUpTable;
+	};
+	auto length = [this](double size) -> int
+	{
+		return std::max(1, int(std::lround(size * scale)));
+	};
+	auto odd = [&](double size, int min) -> int
+	{
+		const int l = length(size);
+		return std::max(min, l % 2 ? l : l + 1);
+	};
+	auto area = [this](double size) -> int
+	{
+		return int(std::lround(size * scale * scale));
+	};
+	auto ellipse = [&](int size) -> cv::Mat
+	{
+		return cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(length(size), length(size)));
+	};
+
+	// Lookup tables
+	segmentation_lut = gamma_lut(Segmentation::GAMMA);
+	salad_lut = gamma_lut(Tray::GAMMA);
+	bread_lut = gamma_lut(BoundingBoxes::GAMMA);
+
+	// Structuring elements
+	segmentation_first_close = ellipse(Segmentation::FIRST_CLOSE_KERNEL_SIZE);
+	segmentation_dilate = ellipse(Segmentation::DILATE_KERNEL_SIZE);
+	segmentation_second_close = ellipse(Segmentation::SECOND_CLOSE_KERNEL_SIZE);
+	segmentation_open = ellipse(Segmentation::OPEN_KERNEL_SIZE);
+	salad_initial_close = ellipse(Tray::INITIAL_KERNEL_SIZE);
+	salad_kernel = ellipse(Tray::KERNEL_SIZE);
+	bread_close = ellipse(BoundingBoxes::CLOSE_KERNEL_SIZE);
+	bread_dilate = ellipse(BoundingBoxes::DILATE_KERNEL_SIZE);
+
+	// Colour tables
+	c_ranges = Segmentation::c_ranges;
+
+	// Pixel parameters
+	gaussian_blur_kernel_size = odd(BoundingBoxes::GAUSSIAN_BLUR_KERNEL_SIZE, 1);
+	gaussian_blur_sigma = BoundingBoxes::GAUSSIAN_BLUR_SIGMA * scale;
+	hough_circle_roundness = length(BoundingBoxes::HOUGH_CIRCLE_ROUNDNESS);
+	plates_min_radius = length(BoundingBoxes::PLATES_MIN_RADIUS);
+	plates_max_radius = length(BoundingBoxes::PLATES_MAX_RADIUS);
+	bowl_min_radius = length(BoundingBoxes::BOWL_MIN_RADIUS);
+	bowl_max_radius = length(BoundingBoxes::BOWL_MAX_RADIUS);
+	min_distance_between_circles = length(BoundingBoxes::MIN_DISTANCE_BETWEEN_CIRCLES);
+	bread_min_area = area(BoundingBoxes::MIN_AREA_THRESHOLD);
+	bread_max_area = area(BoundingBoxes::MAX_AREA_THRESHOLD);
+	bread_min_size = length(BoundingBoxes::MIN_SIZE);
+	circle_neighborhood = length(BoundingBoxes::CIRCLE_NEIGHBORHOOD);
+	niblack_block_size = odd(BoundingBoxes::NIBLACK_BLOCK_SIZE, 3);
+	segmentation_blur_strength = odd(Segmentation::BLUR_STRENGTH, 1);
+	salad_blur_strength = odd(Tray::BLUR_STRENGTH, 1);
+	segmentation_area_threshold = area(Segmentation::AREA_THRESHOLD);
+	salad_area_threshold = area(Tray::AREA_THRESHOLD);
+}
+
+const Resources& Resources::shared()
+{
+	static const Resources resources;   // Built on first use, thread-safe initialization
+	return resources;
+}
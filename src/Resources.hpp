@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+class Resources
+{
+public:
+	/**
+	 * @brief Construct a new Resources object, building once the lookup tables, structuring elements and colour tables used by the pipeline.
+	 * @param s The processing scale wrt the dataset resolution, every pixel parameter is derived from it.
+	 */
+	Resources(double s = 1.0);
+	/**
+	 * @brief Instance shared by the callers that do not own one (e.g. through a Context). Immutable, so safe to share between threads.
+	 * @return The shared instance.
+	 */
+	static const Resources& shared();
+
+	// Lookup tables
+	cv::Mat segmentation_lut;   // Gamma correction of Segmentation
+	cv::Mat salad_lut;          // Gamma correction of the salad in Tray
+	cv::Mat bread_lut;          // Gamma correction of BoundingBoxes bread detection
+
+	// Structuring elements
+	cv::Mat segmentation_first_close, segmentation_dilate, segmentation_second_close, segmentation_open;
+	cv::Mat salad_initial_close, salad_kernel;
+	cv::Mat bread_close, bread_dilate;
+
+	// Colour tables
+	std::vector<std::pair<cv::Scalar, cv::Scalar>> c_ranges;   // BGR min and max ranges of each class
+
+	// Pixel parameters, lengths scaled by the scale and areas by its square
+	double scale;
+	int gaussian_blur_kernel_size;                       // Odd
+	double gaussian_blur_sigma;
+	int hough_circle_roundness;                          // Accumulator votes grow with the circumference
+	int plates_min_radius, plates_max_radius, bowl_min_radius, bowl_max_radius, min_distance_between_circles;
+	int bread_min_area, bread_max_area, bread_min_size, circle_neighborhood;
+	int niblack_block_size;                              // Odd, at least 3
+	int segmentation_blur_strength, salad_blur_strength;   // Odd
+	int segmentation_area_threshold, salad_area_threshold;
+};
@@ -1,40 +1,49 @@
 # include "Segmentation.hpp"
 
+#include "BitMask.hpp"
+#include "Morphology.hpp"
+#include "Profiler.hpp"
+#include "ThreadBudget.hpp"
+#include "Tiles.hpp"
+
+#include <algorithm>
+#include <future>
+
 #define DEBUG false
+#define PARALLEL true   // segment the labels concurrently, within the spare cores of the thread budget
 
-Segmentation::Segmentation(cv::Mat& p, std::vector<int> l)
-	: plate(p), labels(l)
+Segmentation::Segmentation(cv::Mat& p, std::vector<int> l, const Resources& r, Deadline* deadline)
+	: plate(p), labels(l), resources(r)
 {
+	Profiler::Scope scope(Profiler::SEGMENTATION);
 	segments = cv::Mat::zeros(plate.size(), CV_8UC1);
 
 	// Correction
 	cv::Mat corrected;
-	correction(plate, corrected);
+	correction(plate, corrected, resources);
 	if (DEBUG) cv::imshow("corrected", corrected);
 
-	// Segmentation
-	for (const auto label : labels)
+	// Mask of a label, independent of the other labels
+	auto label_mask = [&](int label) -> cv::Mat
 	{
-		if (label == 12) continue;
-
+		Profiler::Scope scope(Profiler::SEGMENTATION);   // Possibly on another thread
 		cv::Mat ranged, mask;
-		cv::inRange(corrected, c_ranges[label].first, c_ranges[label].second, ranged);
-		process(ranged, mask);
+		cv::inRange(corrected, resources.c_ranges[label].first, resources.c_ranges[label].second, ranged);
+		process(ranged, mask, resources);
 
-		// If label seafood salad and beans are both present
-		if (label == 9 and std::find(labels.begin(), labels.end(), 10) != labels.end())
+		// Beans removed from the seafood salad
+		auto separate_beans = [&]() -> void
 		{
 			cv::Mat tmp, beans;
-			cv::inRange(corrected, c_ranges[10].first, c_ranges[10].second, tmp);
-			process(tmp, beans);
+			cv::inRange(corrected, resources.c_ranges[10].first, resources.c_ranges[10].second, tmp);
+			process(tmp, beans, resources);
 
 			// Remove beans from mask
 			cv::bitwise_not(beans, beans);
 			cv::bitwise_and(mask, beans, mask);
 			
 			// Morphological opening
-			cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5));
-			cv::morphologyEx(mask, mask, cv::MORPH_OPEN, kernel);
+			cv::morphologyEx(mask, mask, cv::MORPH_OPEN, resources.segmentation_open);
 
 			// Keep only largest connected component
 			std::vector<std::vector<cv::Point>> contours;
@@ -46,14 +55,40 @@ Segmentation::Segmentation(cv::Mat& p, std::vector<int> l)
 			cv::Mat1b mask_tmp = cv::Mat::zeros(mask.size(), CV_8UC1);
 			cv::drawContours(mask_tmp, contours, max - areas.begin(), cv::Scalar(255), cv::FILLED);
 			mask = mask_tmp;
+		};
+
+		// If label seafood salad and beans are both present, unless there is no time left
+		if (label == 9 and std::find(labels.begin(), labels.end(), 10) != labels.end())
+		{
+			if (deadline) deadline->run(Deadline::BEANS, separate_beans);
+			else separate_beans();
 		}
 
-		cv::threshold(mask, mask, 0, label, cv::THRESH_BINARY);
-		mask = mask - segments * 255;
-		segments = segments | mask;
+		return mask;
+	};
+
+	// Segmentation: the labels run concurrently, then are merged in order so that the earlier labels keep the contended pixels
+	std::vector<std::pair<int, std::future<cv::Mat>>> tasks;
+	for (const auto label : labels)
+	{
+		if (label == 12) continue;
+		tasks.emplace_back(label, PARALLEL ? ThreadBudget::spawn([&, label]() { return label_mask(label); }) : std::async(std::launch::deferred, label_mask, label));
+	}
+
+	BitMask covered(plate.rows, plate.cols);   // Pixels already assigned to a label
+	for (auto& [label, task] : tasks)
+	{
+		cv::Mat mask = task.get();
+
+		// Keep only the pixels not assigned to a previous label
+		BitMask found = BitMask(mask) & ~covered;
 		
 		// If all black, skip
-		if (cv::countNonZero(mask) != 0) {
+		if (!found.none()) {
+			covered |= found;
+			mask = found.toMat(label);
+			segments = segments | mask;
+
 			// Find bounding box of mask
 			std::vector<std::vector<cv::Point>> contours;
 			cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
@@ -82,16 +117,11 @@ Segmentation::Segmentation(cv::Mat& p, std::vector<int> l)
 	}
 }
 
-void Segmentation::correction(cv::Mat& in, cv::Mat& out)
+void Segmentation::correction(cv::Mat& in, cv::Mat& out, const Resources& r)
 {
 	// Gamma transform
 	cv::Mat gamma;
-	cv::Mat lookUpTable(1, 256, CV_8U);
-	uchar* p = lookUpTable.ptr();
-	double gamma_ = 0.5;
-	for (int i = 0; i < 256; ++i)
-		p[i] = cv::saturate_cast<uchar>(pow(i / 255.0, gamma_) * 255.0);
-	cv::LUT(in, lookUpTable, gamma);
+	cv::LUT(in, r.segmentation_lut, gamma);
 
 	// Image to hsv
 	cv::Mat hsv;
@@ -105,7 +135,7 @@ void Segmentation::correction(cv::Mat& in, cv::Mat& out)
 	return;
 }
 
-void Segmentation::process(cv::Mat& in, cv::Mat& out)
+void Segmentation::process(cv::Mat& in, cv::Mat& out, const Resources& r)
 {
 	auto filterAreas = [](const cv::Mat& input, cv::Mat& output, const unsigned int threshold) -> void
 	{
@@ -125,24 +155,52 @@ void Segmentation::process(cv::Mat& in, cv::Mat& out)
 		cv::bitwise_not(ff, inversed_ff);
 		input = (input | inversed_ff);
 	};
-	// Median
-	cv::medianBlur(in, in, 5);
+	auto reach = [](const cv::Mat& kernel) -> int
+	{
+		return std::max(kernel.rows, kernel.cols) / 2;
+	};
+	// Median, as a majority filter on the packed binary mask
+	const BitMask blurred = BitMask(in).majority(r.segmentation_blur_strength);
+	in = blurred.toMat();
+	out = cv::Mat::zeros(in.size(), CV_8UC1);
+
+	// Occupancy: nothing survives the chain of an empty mask, otherwise it runs on the occupied tiles and on the reach of its kernels,
+	// so that the region ends with a ring of zeros and the operations give the same result as on the whole mask
+	const Tiles tiles(blurred);
+	if (tiles.empty()) return;
+	const int halo = 2 * reach(r.segmentation_first_close) + reach(r.segmentation_dilate) + 2 * reach(r.segmentation_second_close) + 1;
+	const cv::Rect region = tiles.bounds(halo);
 
+	// The local steps stream through the rows of the region, the chain is broken only by the global ones (area filter, hole filling)
 	// Closing
-	cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(50, 50));   //changed from 40x40
-	cv::morphologyEx(in, in, cv::MORPH_CLOSE, kernel);
+	cv::Mat closed = Morphology(BitMask(in(region)), { { Morphology::DILATE, r.segmentation_first_close }, { Morphology::ERODE, r.segmentation_first_close } }).getResult().toMat();   //changed from 40x40
 
-	// Dilation
-	out = cv::Mat::zeros(in.size(), CV_8UC1);
-	filterAreas(in, out, 8000);
-	cv::dilate(out, out, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(25, 25)));   //changed from 15x15
+	// Area filter
+	cv::Mat result = cv::Mat::zeros(closed.size(), CV_8UC1);
+	filterAreas(closed, result, r.segmentation_area_threshold);
 
-	// Closing
-	kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(40, 40));   //changed from 15x15
-	cv::morphologyEx(out, out, cv::MORPH_CLOSE, kernel);
+	// Dilation and closing
+	result = Morphology(BitMask(result), {
+		{ Morphology::DILATE, r.segmentation_dilate },          //changed from 15x15
+		{ Morphology::DILATE, r.segmentation_second_close },    //changed from 15x15
+		{ Morphology::ERODE, r.segmentation_second_close } }).getResult().toMat();
 
 	// Filling holes
-	fillHoles(out);
+	fillHoles(result);
 
+	result.copyTo(out(region));
 	return;
+}
+
+std::string Segmentation::parameters()
+{
+	std::string p = "Segmentation;"
+		+ std::to_string(GAMMA) + ";" + std::to_string(BLUR_STRENGTH) + ";" + std::to_string(FIRST_CLOSE_KERNEL_SIZE) + ";" + std::to_string(AREA_THRESHOLD) + ";"
+		+ std::to_string(DILATE_KERNEL_SIZE) + ";" + std::to_string(SECOND_CLOSE_KERNEL_SIZE) + ";" + std::to_string(OPEN_KERNEL_SIZE);
+
+	for (const auto& range : c_ranges)
+		for (int i = 0; i < 3; i++)
+			p += ";" + std::to_string(range.first[i]) + "-" + std::to_string(range.second[i]);
+
+	return p;
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <string>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
 
+#include "Deadline.hpp"
+#include "Resources.hpp"
+
 class Segmentation
 {
 public:
@@ -11,31 +15,43 @@ public:
 	 * @brief Construct a new Segmentation object, segmenting the plate into the different dishes.
 	 * @param p The plate image.
 	 * @param l The labels of the dishes.
+	 * @param r The lookup tables, structuring elements and colour tables to use.
+	 * @param deadline The latency budget of the image, unlimited if null: without time left the beans are not separated from the seafood salad.
 	 */
-	Segmentation(cv::Mat& p, std::vector<int> l);
+	Segmentation(cv::Mat& p, std::vector<int> l, const Resources& r = Resources::shared(), Deadline* deadline = nullptr);
 	cv::Mat getSegments() const { return segments; }
 	std::vector<std::pair<int, cv::Rect>> getBoxes() const { return boxes; }
-
-private:
-	cv::Mat plate;
-	const std::vector<int> labels;
-	cv::Mat segments;
-	std::vector<std::pair<int, cv::Rect>> boxes;
+	/**
+	 * @brief Textual description of every parameter that affects the segmentation, used to invalidate cached results.
+	 * @return The parameters string.
+	 */
+	static std::string parameters();
 	/**
 	 * @brief Gamma correction and HSV conversion.
 	 * @param in The input image.
 	 * @param out The output image.
+	 * @param r The lookup tables to use.
 	 */
-	void correction(cv::Mat& in, cv::Mat& out);
+	static void correction(cv::Mat& in, cv::Mat& out, const Resources& r = Resources::shared());
 	/**
 	 * @brief Morphological operations.
 	 * @param ranged The input image.
 	 * @param out The output image.
+	 * @param r The structuring elements to use.
 	 */
-	void process(cv::Mat& ranged, cv::Mat& out);
+	static void process(cv::Mat& ranged, cv::Mat& out, const Resources& r = Resources::shared());
+
+	// Parameters
+	static constexpr double GAMMA = 0.5;
+	static constexpr int BLUR_STRENGTH = 5;
+	static constexpr int FIRST_CLOSE_KERNEL_SIZE = 50;
+	static constexpr unsigned int AREA_THRESHOLD = 8000;
+	static constexpr int DILATE_KERNEL_SIZE = 25;
+	static constexpr int SECOND_CLOSE_KERNEL_SIZE = 40;
+	static constexpr int OPEN_KERNEL_SIZE = 5;
 
 	// BGR min and max ranges
-	const std::vector<std::pair<cv::Scalar,cv::Scalar>> c_ranges = {
+	static inline const std::vector<std::pair<cv::Scalar,cv::Scalar>> c_ranges = {
 		std::make_pair<cv::Scalar,cv::Scalar>(cv::Scalar(0,0,0), cv::Scalar(0,0,0)),			// black
 		std::make_pair<cv::Scalar,cv::Scalar>(cv::Scalar(2,109,168), cv::Scalar(59,167,255)),	// pasta with pesto
 		std::make_pair<cv::Scalar,cv::Scalar>(cv::Scalar(0,139,153), cv::Scalar(52,255,255)),	// pasta with tomato sauce
@@ -51,4 +67,11 @@ private:
 		std::make_pair<cv::Scalar,cv::Scalar>(cv::Scalar(0,0,0), cv::Scalar(0,0,0)),			// salad // for CLIP this is empty plate
 		std::make_pair<cv::Scalar,cv::Scalar>(cv::Scalar(0,0,0), cv::Scalar(0,0,0))				// bread // never appears in CLIP
 	};
+
+private:
+	cv::Mat plate;
+	const std::vector<int> labels;
+	const Resources& resources;
+	cv::Mat segments;
+	std::vector<std::pair<int, cv::Rect>> boxes;
 };
\ No newline at end of file
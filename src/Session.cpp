@@ -0,0 +1,51 @@
+#include "Session.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+#define DEBUG false
+
+Session::Session(Context& c, const cv::Mat& food_image)
+	: Session(c, c.process(food_image))
+{
+}
+
+Session::Session(Context& c, const Context::Result& f)
+	: context(c), food(f), food_areas(areas(f.mask))
+{
+	for (const auto& labels : food.labels)
+		for (const auto label : labels)
+			if (std::find(candidates.begin(), candidates.end(), label) == candidates.end()) candidates.push_back(label);
+}
+
+Session::Leftover Session::leftover(const cv::Mat& image)
+{
+	Leftover left;
+	left.result = context.process(image, candidates);
+	const std::map<int, int> left_areas = areas(left.result.mask);
+	for (const auto& [label, area] : food_areas)
+	{	// A food missing from the leftover was eaten, a food absent from the food image has no ratio
+		const auto found = left_areas.find(label);
+		left.ratios[label] = found == left_areas.end() ? 0.0 : (double)found->second / area;
+		if (DEBUG) std::cout << "Session: leftover " << leftovers + 1 << ", food " << label << " = " << left.ratios[label] << std::endl;
+	}
+	leftovers++;
+	return left;
+}
+
+std::map<int, int> Session::areas(const cv::Mat& mask)
+{
+	CV_Assert(mask.empty() || mask.type() == CV_8UC1);
+	std::array<int, 256> counts{};
+	for (int y = 0; y < mask.rows; y++)
+	{
+		const uchar* row = mask.ptr<uchar>(y);
+		for (int x = 0; x < mask.cols; x++)
+			counts[row[x]]++;
+	}
+	std::map<int, int> result;
+	for (int label = 1; label < 256; label++)
+		if (counts[label] > 0) result[label] = counts[label];
+	return result;
+}
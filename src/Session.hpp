@@ -0,0 +1,61 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Context.hpp"
+
+class Session
+{
+public:
+	/**
+	 * @brief Result of a leftover image.
+	 */
+	struct Leftover
+	{
+		Context::Result result;         // Label map and boxes of the leftover image
+		std::map<int, double> ratios;   // Leftover ratio of each food of the food image: its area in the leftover over its area in the food image
+	};
+
+	/**
+	 * @brief Construct a new Session object for a tray, processing its food image once: its areas, plates and labels are kept,
+	 * so that each leftover image is estimated as soon as it arrives, at the cost of segmenting that image only.
+	 * @param context The context processing the images, kept by reference for the whole session.
+	 * @param food_image The food image of the tray.
+	 */
+	Session(Context& context, const cv::Mat& food_image);
+	/**
+	 * @brief Construct a new Session object for a tray whose food image was already processed (e.g. restored from a previous run).
+	 * @param context The context processing the leftover images, kept by reference for the whole session.
+	 * @param food The result of the food image.
+	 */
+	Session(Context& context, const Context::Result& food);
+
+	/**
+	 * @brief Process a leftover image of the tray, its plates labeled among the foods of the food image, and estimate the leftover of each food.
+	 * @param image The leftover image.
+	 * @return The result and the leftover ratios.
+	 */
+	Leftover leftover(const cv::Mat& image);
+
+	/**
+	 * @brief Area of each label of a label map, in one pass.
+	 * @param mask The label map.
+	 * @return The number of pixels of each label, background excluded.
+	 */
+	static std::map<int, int> areas(const cv::Mat& mask);
+
+	const Context::Result& getFood() const { return food; }
+	const std::map<int, int>& getAreas() const { return food_areas; }
+	const std::vector<int>& getCandidates() const { return candidates; }
+	int getLeftovers() const { return leftovers; }
+
+private:
+	Context& context;
+	Context::Result food;              // Result of the food image: label map, boxes, plates and their labels
+	std::map<int, int> food_areas;     // Area of each food in the food image
+	std::vector<int> candidates;       // Labels of the plates of the food image, the only ones the leftover plates can have
+	int leftovers = 0;                 // Leftover images processed
+};
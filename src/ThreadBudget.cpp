@@ -0,0 +1,132 @@
+#include "ThreadBudget.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define DEBUG false
+
+std::atomic<int> ThreadBudget::spare{ std::max(0, int(std::thread::hardware_concurrency()) - 1) };   // One worker until a budget is applied
+
+ThreadBudget::ThreadBudget(int c, int w, int i, bool p)
+	: workers(std::max(w, 1)), interpreters(std::max(i, 0)), pin(p), allowed(allowedCores())
+{
+	cores = c > 0 ? c : int(allowed.size());
+	// OpenCV parallel regions run on one pool per process: its size is the share of one worker, so that concurrent workers fill the budget
+	opencv = std::max(1, cores / workers);
+	// Interpreters mostly run concurrently with each other, not with the native stages: the budget is split among them
+	torch = interpreters > 0 ? std::max(1, cores / interpreters) : 0;
+	// Encoding the outputs is light, it overlaps with the next images
+	writer = std::max(1, cores / 4);
+	// The threads of the fan-outs of an image run next to the workers, on the cores they leave
+	fanout = std::max(0, cores - workers);
+}
+
+void ThreadBudget::apply()
+{
+	auto set = [](const char* name, int value) -> void
+	{
+#ifdef _WIN32
+		_putenv_s(name, std::to_string(value).c_str());
+#else
+		setenv(name, std::to_string(value).c_str(), 1);
+#endif
+	};
+
+	cv::setNumThreads(opencv);
+	if (torch > 0)
+	{	// Read by CLIP_interface, and by the native runtimes of torch in the processes started from now on
+		set("CLIP_THREADS", torch);
+		set("OMP_NUM_THREADS", torch);
+	}
+
+	spare = fanout;
+
+	// Threads created from now on inherit the affinity of the main thread, among the cores the process may already be restricted to
+	const std::vector<int> budget(allowed.begin(), allowed.begin() + std::min<size_t>(cores, allowed.size()));
+	applied_pin = pin && !budget.empty() && setAffinity(budget, true);
+}
+
+void ThreadBudget::pinWorker(int worker) const
+{
+	if (!applied_pin) return;
+	const int pinned = std::min<int>(cores, int(allowed.size()));
+	const int share = std::max(1, pinned / workers);
+	std::vector<int> set;
+	for (int k = 0; k < share; k++)
+		set.push_back(allowed[((worker % workers) * share + k) % pinned]);
+	setAffinity(set);
+}
+
+std::string ThreadBudget::report() const
+{
+	char line[256];
+	std::snprintf(line, sizeof(line), "Thread budget: %d cores%s, %d pipeline workers + %d fan-out threads, %d OpenCV threads, %d CLIP interpreters x %d PyTorch threads, %d writer threads",
+		cores, applied_pin ? " (pinned)" : "", workers, fanout, opencv, interpreters, torch, writer);
+	return line;
+}
+
+bool ThreadBudget::acquire()
+{
+	int s = spare.load(std::memory_order_relaxed);
+	while (s > 0 && !spare.compare_exchange_weak(s, s - 1, std::memory_order_relaxed));
+	return s > 0;
+}
+
+void ThreadBudget::release()
+{
+	spare.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<int> ThreadBudget::allowedCores()
+{
+	std::vector<int> cores;
+#ifdef _WIN32
+	DWORD_PTR process_mask = 0, system_mask = 0;
+	if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+		for (int c = 0; c < int(sizeof(DWORD_PTR) * 8); c++)
+			if (process_mask & (DWORD_PTR(1) << c)) cores.push_back(c);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		for (int c = 0; c < CPU_SETSIZE; c++)
+			if (CPU_ISSET(c, &set)) cores.push_back(c);
+#endif
+	if (cores.empty())
+		for (int c = 0; c < int(std::max(1u, std::thread::hardware_concurrency())); c++)
+			cores.push_back(c);
+	return cores;
+}
+
+bool ThreadBudget::setAffinity(const std::vector<int>& set, bool process)
+{
+#ifdef _WIN32
+	DWORD_PTR mask = 0;
+	for (const int c : set)
+		if (c < int(sizeof(DWORD_PTR) * 8)) mask |= DWORD_PTR(1) << c;
+	if (!mask) return false;
+	return process ? SetProcessAffinityMask(GetCurrentProcess(), mask) != 0 : SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	for (const int c : set)
+		if (c < CPU_SETSIZE) CPU_SET(c, &cpus);
+	(void)process;
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+	(void)set; (void)process;
+	return false;   // No affinity on this platform, the thread counts still apply
+#endif
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+
+class ThreadBudget
+{
+public:
+	/**
+	 * @brief Construct a new ThreadBudget object, dividing a core budget among the pipeline workers, the OpenCV threads, the PyTorch threads
+	 * of each CLIP interpreter and the output writer, so that the libraries do not each size themselves to the whole machine.
+	 * @param cores The core budget, all the cores the process is allowed to run on if 0.
+	 * @param workers The pipeline workers processing images concurrently.
+	 * @param interpreters The CLIP interpreters classifying concurrently (the embedded one or the worker processes), none if 0.
+	 * @param pin Whether to pin the process to the first cores of the budget among the ones it is allowed to run on, and each worker to its share of them.
+	 */
+	ThreadBudget(int cores = 0, int workers = 1, int interpreters = 1, bool pin = false);
+
+	/**
+	 * @brief Apply the budget to the process, once at startup before the interpreters and the threads are created:
+	 * cv::setNumThreads, CLIP_THREADS and OMP_NUM_THREADS for the interpreters (inherited by the worker processes), affinity if pinned.
+	 */
+	void apply();
+	/**
+	 * @brief Pin the calling thread to the share of the cores of a pipeline worker, if pinned.
+	 * @param worker The index of the worker.
+	 */
+	void pinWorker(int worker) const;
+	/**
+	 * @brief Run a task of the fan-out of an image (plates, labels, salad and bread) on a new thread if the budget has a spare core for it,
+	 * otherwise deferred to the caller of get(): the workers and their fan-outs together stay within the cores of the budget.
+	 * @param task The task.
+	 * @return The future of its result.
+	 */
+	template<class F>
+	static auto spawn(F&& task) -> std::future<decltype(task())>
+	{
+		if (!acquire()) return std::async(std::launch::deferred, std::forward<F>(task));
+		return std::async(std::launch::async, [task = std::forward<F>(task)]() mutable
+		{
+			struct Slot { ~Slot() { release(); } } slot;
+			return task();
+		});
+	}
+	/**
+	 * @brief Summary of the effective allocation.
+	 * @return The report.
+	 */
+	std::string report() const;
+
+	int getCores() const { return cores; }
+	int getWorkers() const { return workers; }
+	int getOpenCVThreads() const { return opencv; }
+	int getTorchThreads() const { return torch; }
+	int getWriterThreads() const { return writer; }
+	int getFanoutThreads() const { return fanout; }
+
+private:
+	int cores, workers, interpreters;
+	int opencv;     // OpenCV threads, shared by the workers of the process
+	int torch;      // PyTorch intra-op threads of each interpreter
+	int writer;     // Threads of the output writer
+	bool pin;
+	bool applied_pin = false;   // Whether the affinity could be set
+	int fanout;                 // Threads the fan-outs of the workers can add, the cores left by the workers
+	std::vector<int> allowed;   // Cores the process is allowed to run on, in order
+	static std::atomic<int> spare;   // Fan-out threads that can still be started
+
+	/**
+	 * @brief Take a spare core for a fan-out thread, if any.
+	 * @return False if all of them are busy.
+	 */
+	static bool acquire();
+	/**
+	 * @brief Give back the spare core of a fan-out thread.
+	 */
+	static void release();
+	/**
+	 * @brief Cores the process is allowed to run on, e.g. restricted by taskset, cgroups or a job object.
+	 * @return The core indexes, the first hardware threads if not supported.
+	 */
+	static std::vector<int> allowedCores();
+	/**
+	 * @brief Set the affinity of the calling thread to a set of cores.
+	 * @param process Whether the threads created later inherit it (the whole process on Windows, where threads do not inherit).
+	 * @return False if not supported or refused.
+	 */
+	static bool setAffinity(const std::vector<int>& set, bool process = false);
+};
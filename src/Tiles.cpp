@@ -0,0 +1,36 @@
+#include "Tiles.hpp"
+
+#include <algorithm>
+
+#define DEBUG false
+
+Tiles::Tiles(const BitMask& mask)
+	: rows(mask.getRows()), cols(mask.getCols()), tile_rows((rows + SIZE - 1) / SIZE), tile_cols((cols + SIZE - 1) / SIZE), occupied(size_t(tile_rows) * tile_cols, 0)
+{
+	for (int y = 0; y < rows; y++)
+	{
+		const uint64_t* words = mask.row(y);
+		uchar* tiles = &occupied[size_t(y / SIZE) * tile_cols];
+		for (int w = 0; w < mask.getWords(); w++)
+			tiles[w] |= words[w] != 0;
+	}
+	for (const auto tile : occupied) occupied_count += tile;
+}
+
+cv::Rect Tiles::bounds(int halo) const
+{
+	int min_x = tile_cols, min_y = tile_rows, max_x = -1, max_y = -1;
+	for (int ty = 0; ty < tile_rows; ty++)
+		for (int tx = 0; tx < tile_cols; tx++)
+			if (get(ty, tx))
+			{
+				min_x = std::min(min_x, tx);
+				min_y = std::min(min_y, ty);
+				max_x = std::max(max_x, tx);
+				max_y = std::max(max_y, ty);
+			}
+	if (max_x < 0) return cv::Rect();
+
+	const cv::Rect region(min_x * SIZE - halo, min_y * SIZE - halo, (max_x - min_x + 1) * SIZE + 2 * halo, (max_y - min_y + 1) * SIZE + 2 * halo);
+	return region & cv::Rect(0, 0, cols, rows);
+}
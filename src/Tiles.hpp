@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "BitMask.hpp"
+
+class Tiles
+{
+public:
+	/**
+	 * @brief Construct a new Tiles object, the occupancy map of a mask: which square tiles contain at least one set pixel.
+	 * A tile is one word of the packed mask wide, so that it is occupied if any of its words is non zero.
+	 * @param mask The packed mask.
+	 */
+	explicit Tiles(const BitMask& mask);
+
+	bool empty() const { return occupied_count == 0; }
+	int count() const { return occupied_count; }
+	bool get(int ty, int tx) const { return occupied[ty * tile_cols + tx]; }
+
+	/**
+	 * @brief Region to process: the bounding rectangle of the occupied tiles, grown by a halo and clipped to the mask.
+	 * @param halo The margin around the occupied tiles, at least the reach of the operations to run on the region.
+	 * @return The region, empty if no tile is occupied.
+	 */
+	cv::Rect bounds(int halo) const;
+
+	static constexpr int SIZE = 64;   // Side of the tiles, one word of the packed mask
+
+private:
+	int rows, cols;                   // Size of the mask
+	int tile_rows, tile_cols;         // Size of the map
+	int occupied_count = 0;           // Occupied tiles
+	std::vector<uchar> occupied;      // Row-major map, non zero where the tile is occupied
+};
@@ -0,0 +1,161 @@
+#include "Tray.hpp"
+
+#include "Utils.hpp"
+#include "BitMask.hpp"
+#include "Morphology.hpp"
+#include "Profiler.hpp"
+#include "ThreadBudget.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+
+#define DEBUG false
+#define PARALLEL true   // run the salad and the bread concurrently with the plates, within the spare cores of the thread budget
+
+Tray::Tray(const cv::Mat& image, const BoundingBoxes& bb, const std::vector<cv::Mat>& masks, const std::vector<std::vector<std::pair<int, cv::Rect>>>& boxes, const Resources& r, Deadline* deadline)
+{
+	const std::vector<cv::Vec3f> plates = bb.getPlates();
+	const std::pair<bool, cv::Vec3f> salad = bb.getSalad();
+	const std::pair<bool, cv::Mat> bread = bb.getBread();
+	tray_mask = cv::Mat::zeros(image.size(), CV_8UC1);
+
+	// SALAD: Process the salad in the image, independent of the plates
+	auto salad_task = [&]() -> std::pair<cv::Mat, cv::Rect>
+	{
+		Profiler::Scope scope(Profiler::SALAD);
+		cv::Mat salad_image = utils::cutout(image, salad.second);   // Cut out the salad from the image
+
+		// Gamma correction
+		cv::Mat gamma;
+		cv::LUT(salad_image, r.salad_lut, gamma);
+
+		// HSV equalization
+		cv::Mat hsv;
+		cv::cvtColor(gamma, hsv, cv::COLOR_BGR2HSV);
+		std::vector<cv::Mat> hsv_channels;
+		cv::split(hsv, hsv_channels);
+		cv::equalizeHist(hsv_channels[1], hsv_channels[1]);
+
+		// Thresholding
+		cv::Mat mask;
+		cv::threshold(hsv_channels[1], mask, SATURATION_THRESHOLD, SALAD_LABEL, cv::THRESH_BINARY);
+
+		// Morphological operations
+		mask = process(mask, r);
+		cv::threshold(mask, mask, 0, SALAD_LABEL, cv::THRESH_BINARY);   // Thresholding again to the correct label
+
+		// Find the bounding box of the salad
+		std::vector<std::vector<cv::Point>> contours;                                   // Contours of the salad
+		cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);   // Find the contours of the salad
+		std::vector<cv::Rect> box(contours.size());                                     // Bounding boxes of the salad
+
+		for (int i = 0; i < contours.size(); i++)
+			box[i] = cv::boundingRect(contours[i]);  // Get the bounding boxes of the salad
+		auto min = std::min_element(box.begin(), box.end(), [](const cv::Rect& a, const cv::Rect& b) { return a.area() < b.area(); });   // Get the smallest bounding box
+
+		int x = min->x + salad.second[0] - salad.second[2];   // Get the x coordinate of the bounding box wrt the true image
+		int y = min->y + salad.second[1] - salad.second[2];   // Get the y coordinate of the bounding box wrt the true image
+		return std::make_pair(mask, cv::Rect(x, y, min->width, min->height));
+	};
+
+	// Coarse salad: the whole bowl, when there is no time left to threshold it
+	auto bowl_task = [&]() -> std::pair<cv::Mat, cv::Rect>
+	{
+		const int diameter = cvRound(2 * salad.second[2]);
+		const cv::Rect box = cv::Rect(cvRound(salad.second[0] - salad.second[2]), cvRound(salad.second[1] - salad.second[2]), diameter, diameter) & cv::Rect(0, 0, image.cols, image.rows);
+		return std::make_pair(cv::Mat(diameter, diameter, CV_8UC1, cv::Scalar(SALAD_LABEL)), box);   // Pasted inside the circle only
+	};
+	auto refined_salad_task = [&]() -> std::pair<cv::Mat, cv::Rect>
+	{
+		std::pair<cv::Mat, cv::Rect> result;
+		if (deadline && !deadline->run(Deadline::SALAD, [&]() { result = salad_task(); }))
+			return bowl_task();
+		return deadline ? result : salad_task();
+	};
+
+	// BREAD: Process the bread in the image, independent of the plates
+	auto bread_task = [&]() -> std::pair<cv::Mat, cv::Rect>
+	{
+		Profiler::Scope scope(Profiler::BREAD);
+		cv::Mat bread_mask;
+		cv::threshold(bread.second, bread_mask, 0, BREAD_LABEL, cv::THRESH_BINARY);   // Thresholding to the correct label
+
+		// Bounding box
+		std::vector<std::vector<cv::Point>> contours;
+		cv::findContours(bread_mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+		return std::make_pair(bread_mask, cv::boundingRect(contours[0]));
+	};
+
+	// Salad and bread run while the plates are composed, then everything is merged in the sequential order
+	std::future<std::pair<cv::Mat, cv::Rect>> salad_result, bread_result;
+	if (salad.first) salad_result = PARALLEL ? ThreadBudget::spawn(refined_salad_task) : std::async(std::launch::deferred, refined_salad_task);
+	if (bread.first) bread_result = PARALLEL ? ThreadBudget::spawn(bread_task) : std::async(std::launch::deferred, bread_task);
+
+	// PLATES: Add each plate to the tray
+	for (int j = 0; j < masks.size(); j++)
+	{	// For each plate [j] in the image
+		for (const auto& box : boxes[j])
+		{   // For each bounding box 'box' in the plate [j]
+			int x = box.second.x + plates[j][0] - plates[j][2];   // Get the x coordinate of the bounding box wrt the true image
+			int y = box.second.y + plates[j][1] - plates[j][2];   // Get the y coordinate of the bounding box wrt the true image
+			tray_boxes.push_back(std::make_pair(box.first, cv::Rect(x, y, box.second.width, box.second.height)));
+		}
+
+		// Add the mask of the plate [j] to the tray mask
+		utils::paste(tray_mask, masks[j], plates[j]);
+	}
+
+	if (DEBUG) { cv::imshow("tray_mask", tray_mask * 15); cv::waitKey(0); }
+
+	if (salad.first)
+	{	// If the salad is present in the image
+		auto [mask, box] = salad_result.get();
+		tray_boxes.push_back(std::make_pair(SALAD_LABEL, box));
+
+		// Add the mask of the salad to the tray mask
+		utils::paste(tray_mask, mask, salad.second);
+
+		if (DEBUG) { cv::imshow("w/salad", tray_mask * 15); cv::waitKey(0); }
+	}
+
+	if (bread.first)
+	{	// If the bread is present in the image
+		auto [mask, box] = bread_result.get();
+		tray_boxes.push_back(std::make_pair(BREAD_LABEL, box));
+		tray_mask = tray_mask + mask;
+
+		if (DEBUG) { cv::imshow("w/bread", tray_mask * 15); cv::waitKey(0); }
+	}
+}
+
+cv::Mat Tray::process(cv::Mat& mask, const Resources& r)
+{
+	auto filterAreas = [](const cv::Mat& input, cv::Mat& output, const unsigned int threshold) -> void
+	{
+		std::vector<std::vector<cv::Point>> c;
+
+		cv::findContours(input.clone(), c, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+		for (int i = 0; i < c.size(); i++)
+			if (cv::contourArea(c[i]) > threshold)
+				cv::drawContours(output, c, i, 255, -1);
+	};
+	auto fillHoles = [](cv::Mat& input) -> void
+	{
+		cv::Mat ff = input.clone();
+		cv::floodFill(ff, cv::Point(0, 0), cv::Scalar(255));
+		cv::Mat inversed_ff;
+		cv::bitwise_not(ff, inversed_ff);
+		input = (input | inversed_ff);
+	};
+
+	// Morphological operations, the local ones streamed through the rows between the global ones
+	cv::Mat output = cv::Mat::zeros(mask.size(), CV_8UC1);
+	const BitMask blurred = BitMask(mask).majority(r.salad_blur_strength);   // Median of the binary mask
+	mask = Morphology(blurred, { { Morphology::DILATE, r.salad_initial_close }, { Morphology::ERODE, r.salad_initial_close } }).getResult().toMat();
+	filterAreas(mask, output, r.salad_area_threshold);
+	output = Morphology(BitMask(output), { { Morphology::DILATE, r.salad_kernel }, { Morphology::DILATE, r.salad_kernel }, { Morphology::ERODE, r.salad_kernel } }).getResult().toMat();
+	fillHoles(output);
+
+	return output;
+}
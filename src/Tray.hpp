@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "BoundingBoxes.hpp"
+#include "Deadline.hpp"
+#include "Resources.hpp"
+
+class Tray
+{
+public:
+	/**
+	 * @brief Construct a new Tray object, composing the plates segments, the salad and the bread into the final mask and boxes of the tray.
+	 * @param image The tray image.
+	 * @param bb The plates, salad and bread found in the image.
+	 * @param masks The segments of each plate, as computed by Segmentation.
+	 * @param boxes The labeled boxes of each plate wrt its cutout, as computed by Segmentation.
+	 * @param r The lookup tables and structuring elements to use.
+	 * @param deadline The latency budget of the image, unlimited if null: without time left the whole bowl is labeled as salad.
+	 */
+	Tray(const cv::Mat& image, const BoundingBoxes& bb, const std::vector<cv::Mat>& masks, const std::vector<std::vector<std::pair<int, cv::Rect>>>& boxes, const Resources& r = Resources::shared(), Deadline* deadline = nullptr);
+	cv::Mat getMask() const { return tray_mask; }
+	std::vector<std::pair<int, cv::Rect>> getBoxes() const { return tray_boxes; }
+
+	/**
+	 * @brief Morphological operations on the salad mask.
+	 * @param mask The thresholded salad mask.
+	 * @param r The structuring elements to use.
+	 * @return The processed mask.
+	 */
+	static cv::Mat process(cv::Mat& mask, const Resources& r = Resources::shared());
+
+	// Salad parameters
+	static constexpr int SALAD_LABEL = 12;
+	static constexpr unsigned int SATURATION_THRESHOLD = 206;
+	static constexpr double GAMMA = 0.5;
+	static constexpr unsigned int BLUR_STRENGTH = 5;
+	static constexpr unsigned int INITIAL_KERNEL_SIZE = 40;
+	static constexpr unsigned int AREA_THRESHOLD = 8000;
+	static constexpr unsigned int KERNEL_SIZE = 15;
+
+	// Bread parameters
+	static constexpr int BREAD_LABEL = 13;
+
+private:
+	cv::Mat tray_mask;                                  // Final mask of the tray
+	std::vector<std::pair<int, cv::Rect>> tray_boxes;   // Final bounding boxes of the tray
+};
@@ -0,0 +1,90 @@
+#include "Utils.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+cv::Mat utils::cutout(const cv::Mat& image, const cv::Vec3f& circle)
+{
+	const int x = cvRound(circle[0] - circle[2]) > 0 ? cvRound(circle[0] - circle[2]) : 0;
+	const int y = cvRound(circle[1] - circle[2]) > 0 ? cvRound(circle[1] - circle[2]) : 0;
+	const int w = x + cvRound(2 * circle[2]) < image.cols ? cvRound(2 * circle[2]) : image.cols - x;
+	const int h = y + cvRound(2 * circle[2]) < image.rows ? cvRound(2 * circle[2]) : image.rows - y;
+
+	//return image inside circle
+	cv::Mat mask = cv::Mat::zeros(image.size(), CV_8UC1);
+	cv::circle(mask, cv::Point(cvRound(circle[0]), cvRound(circle[1])), cvRound(circle[2]), cv::Scalar(255), -1);
+	cv::Mat res;
+	image.copyTo(res, mask);
+	return res(cv::Rect(x, y, w, h));
+}
+
+void utils::paste(cv::Mat& tray_mask, const cv::Mat& mask, const cv::Vec3f& circle)
+{
+	for (int k = 0; k < mask.rows; k++)   // For each row [k] in the mask
+		for (int l = 0; l < mask.cols; l++)   // For each column [l] in the mask
+			if (pow(k - circle[2], 2) + pow(l - circle[2], 2) <= pow(circle[2], 2))   // Replace in the tray mask only the pixels inside the circle, not the whole rectangle
+				if (k + circle[1] - circle[2] >= 0 && k + circle[1] - circle[2] < tray_mask.rows && l + circle[0] - circle[2] >= 0 && l + circle[0] - circle[2] < tray_mask.cols)
+					tray_mask.at<uchar>(k + circle[1] - circle[2], l + circle[0] - circle[2]) = mask.at<uchar>(k, l);
+}
+
+void utils::rescale(cv::Mat& mask, std::vector<std::pair<int, cv::Rect>>& boxes, const cv::Size& size)
+{
+	if (mask.size() == size) return;
+	const double fx = (double)size.width / mask.cols, fy = (double)size.height / mask.rows;
+	cv::resize(mask, mask, size, 0, 0, cv::INTER_NEAREST);
+	for (auto& box : boxes)
+		box.second = cv::Rect(cvRound(box.second.x * fx), cvRound(box.second.y * fy), cvRound(box.second.width * fx), cvRound(box.second.height * fy));
+}
+
+std::vector<std::pair<int, cv::Rect>> utils::readBoxes(const std::string& path)
+{
+	std::vector<std::pair<int, cv::Rect>> boxes;
+	std::ifstream file(path);
+	if (file.is_open())
+	{
+		std::string line;   // Line read from the file
+		while (std::getline(file, line))
+		{   // For each line 'line' in the file
+			int id_start = line.find(":") + 2;    // Start of the id in the line
+			int id_end = line.find(";");          // End of the id in the line
+			int box_start = line.find("[") + 1;   // Start of the box in the line
+			int box_end = line.find("]");         // End of the box in the line
+
+			std::string id = line.substr(id_start, id_end - id_start);      // Extract the id
+			std::string box = line.substr(box_start, box_end - box_start);  // Extract the box
+
+			std::istringstream iss(box);                                                                         // Create a string stream from the box
+			std::vector<std::string> tokens{ std::istream_iterator<std::string>{iss}, std::istream_iterator<std::string>{} };   // Split the box into tokens
+			cv::Rect tmp(std::stoi(tokens[0]), std::stoi(tokens[1]), std::stoi(tokens[2]), std::stoi(tokens[3]));   // Create a rectangle from the box
+			boxes.push_back(std::make_pair(std::stoi(id), tmp));                                                 // Add the pair to the vector
+		}
+		file.close();
+	}
+	return boxes;
+}
+
+size_t utils::residentMemory(bool peak)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return peak ? counters.PeakWorkingSetSize : counters.WorkingSetSize;
+#else
+	// "VmHWM:    1234 kB" (peak) or "VmRSS:    1234 kB" (current)
+	std::ifstream file("/proc/self/status");
+	const std::string key = peak ? "VmHWM:" : "VmRSS:";
+	std::string line;
+	while (std::getline(file, line))
+		if (line.rfind(key, 0) == 0)
+			return std::stoull(line.substr(key.length())) * 1024;
+	return 0;
+#endif
+}
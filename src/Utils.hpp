@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace utils
+{
+	/**
+	 * @brief Cut out the content of a circle, black outside of it, cropped to its bounding square.
+	 * @param image The input image.
+	 * @param circle The circle.
+	 * @return The cutout.
+	 */
+	cv::Mat cutout(const cv::Mat& image, const cv::Vec3f& circle);
+	/**
+	 * @brief Paste a cutout mask back into the tray mask, only inside the circle it was cut from.
+	 * @param tray_mask The tray mask.
+	 * @param mask The cutout mask.
+	 * @param circle The circle the cutout was cut from.
+	 */
+	void paste(cv::Mat& tray_mask, const cv::Mat& mask, const cv::Vec3f& circle);
+	/**
+	 * @brief Bring a label map and its boxes, computed at a processing scale, to another resolution.
+	 * @param mask The label map, resized with nearest neighbour interpolation.
+	 * @param boxes The labeled boxes, scaled accordingly.
+	 * @param size The target resolution.
+	 */
+	void rescale(cv::Mat& mask, std::vector<std::pair<int, cv::Rect>>& boxes, const cv::Size& size);
+	/**
+	 * @brief Read a bounding boxes file in the dataset format, one "ID: <label>; [x, y, w, h]" per line.
+	 * @param path The path of the file.
+	 * @return The labeled boxes, empty if the file cannot be read.
+	 */
+	std::vector<std::pair<int, cv::Rect>> readBoxes(const std::string& path);
+	/**
+	 * @brief Resident set size of the process.
+	 * @param peak True for the peak since the start of the process, false for the current one.
+	 * @return The size in bytes, 0 if not available on this platform.
+	 */
+	size_t residentMemory(bool peak = false);
+}
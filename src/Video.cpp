@@ -0,0 +1,59 @@
+#include "Video.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <stdexcept>
+
+#define DEBUG false
+
+Video::Video(const std::string& source, Context& context, const Callback& callback)
+{
+	auto open = [](const std::string& source) -> cv::VideoCapture
+	{	// A number is a camera index, anything else a file
+		bool camera = !source.empty() && std::all_of(source.begin(), source.end(), [](unsigned char c) { return std::isdigit(c); });
+		return camera ? cv::VideoCapture(std::stoi(source)) : cv::VideoCapture(source);
+	};
+	auto analysis = [](const cv::Mat& frame) -> cv::Mat
+	{	// Small blurred grayscale frame, enough to tell motion and content changes apart from sensor noise
+		cv::Mat small, gray;
+		const double factor = (double)ANALYSIS_WIDTH / frame.cols;
+		cv::resize(frame, small, cv::Size(), factor, factor, cv::INTER_AREA);
+		cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+		cv::GaussianBlur(gray, gray, cv::Size(5, 5), 0);
+		return gray;
+	};
+	auto difference = [](const cv::Mat& a, const cv::Mat& b) -> double
+	{
+		cv::Mat diff;
+		cv::absdiff(a, b, diff);
+		return cv::mean(diff)[0];
+	};
+
+	cv::VideoCapture capture = open(source);
+	if (!capture.isOpened())
+		throw std::runtime_error("Video: cannot open " + source);
+
+	cv::Mat frame, current, previous, last_processed;
+	int still = 0;   // Consecutive static frames
+	while (capture.read(frame) && !frame.empty())
+	{
+		frames++;
+		current = analysis(frame);
+
+		// Motion: the scene must be static for a while before a tray is considered settled
+		still = !previous.empty() && difference(current, previous) < MOTION_THRESHOLD ? still + 1 : 0;
+		previous = current;
+
+		// Settled on a new content: run the pipeline, otherwise reuse
+		if (still >= SETTLE_FRAMES && (last_processed.empty() || difference(current, last_processed) > CHANGE_THRESHOLD))
+		{
+			if (DEBUG) std::cout << "Frame " << frames - 1 << " settled, processing" << std::endl;
+			result = context.process(frame);
+			last_processed = current;
+			processed++;
+			callback(frames - 1, frame, result);
+		}
+		else reused++;
+	}
+}
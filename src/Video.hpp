@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "Context.hpp"
+
+class Video
+{
+public:
+	/**
+	 * @brief Called for every processed frame, i.e. for every tray that settled in the scene.
+	 */
+	using Callback = std::function<void(int frame, const cv::Mat& image, const Context::Result& result)>;
+
+	/**
+	 * @brief Construct a new Video object, reading a continuous capture until its end: a frame goes through the whole pipeline
+	 * only when the scene settled on a content different from the last processed one, otherwise its last result is reused.
+	 * @param source A video file, or the index of a camera.
+	 * @param context The context processing the settled frames.
+	 * @param callback Called for each processed frame.
+	 */
+	Video(const std::string& source, Context& context, const Callback& callback);
+
+	int getFrames() const { return frames; }
+	int getProcessed() const { return processed; }
+	int getReused() const { return reused; }
+	const Context::Result& getResult() const { return result; }
+
+	// Parameters of the frame difference, on downscaled grayscale frames
+	static constexpr int ANALYSIS_WIDTH = 160;          // Width of the downscaled frames
+	static constexpr double MOTION_THRESHOLD = 2.0;     // Mean absolute difference between consecutive frames below which the scene is static
+	static constexpr int SETTLE_FRAMES = 10;            // Consecutive static frames for the tray to be settled
+	static constexpr double CHANGE_THRESHOLD = 6.0;     // Mean absolute difference from the last processed frame above which the content changed
+
+private:
+	int frames = 0;              // Frames read
+	int processed = 0;           // Frames that went through the pipeline
+	int reused = 0;              // Frames that reused the last result
+	Context::Result result;      // Last result
+};
@@ -0,0 +1,210 @@
+#include "Workers.hpp"
+
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#define DEBUG false
+
+Workers::Workers(int c, const std::string& s, std::chrono::milliseconds t)
+	: script(s), timeout(t), count(std::max(c, 1)), processes(std::max(c, 1), 0), busy(std::max(c, 1), false)
+{
+	const char* interpreter = std::getenv("CLIP_PYTHON");
+	const size_t size = count * SLOT_SIZE;
+
+	// Shared memory, private to this process and its workers
+#ifdef _WIN32
+	python = interpreter ? interpreter : "python";
+	name = "food_clip_" + std::to_string(GetCurrentProcessId());
+	HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(uint64_t(size) >> 32), DWORD(size), name.c_str());
+	if (!handle) throw std::runtime_error("Workers: cannot create the shared memory");
+	memory = static_cast<uint8_t*>(MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size));
+	mapping = reinterpret_cast<intptr_t>(handle);
+#else
+	python = interpreter ? interpreter : "python3";
+	name = "food_clip_" + std::to_string(getpid());
+	const int fd = shm_open(("/" + name).c_str(), O_CREAT | O_RDWR, 0600);
+	if (fd < 0) throw std::runtime_error("Workers: cannot create the shared memory");
+	if (ftruncate(fd, size) != 0)
+	{
+		close(fd);
+		shm_unlink(("/" + name).c_str());
+		throw std::runtime_error("Workers: cannot size the shared memory");
+	}
+	void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	memory = view == MAP_FAILED ? nullptr : static_cast<uint8_t*>(view);
+#endif
+	if (!memory) throw std::runtime_error("Workers: cannot map the shared memory");
+	std::memset(memory, 0, size);
+
+	// The workers load the model concurrently, the first requests wait for them
+	for (int i = 0; i < count; i++)
+		start(i);
+}
+
+Workers::~Workers()
+{
+	// Ask the workers to exit, then kill the ones still running
+	for (int i = 0; i < count; i++)
+		state(i).store(STOP, std::memory_order_release);
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+	for (int i = 0; i < count; i++)
+	{
+		while (alive(i) && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(POLL);
+		stop(i);
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(memory);
+	CloseHandle(reinterpret_cast<HANDLE>(mapping));
+#else
+	munmap(memory, count * SLOT_SIZE);
+	shm_unlink(("/" + name).c_str());
+#endif
+}
+
+std::vector<int> Workers::classify(const cv::Mat& plate, const std::vector<int>& candidates, std::vector<float>* scores)
+{
+	Profiler::Scope scope(Profiler::CLIP);
+
+	// First free worker
+	int i;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		available.wait(lock, [this] { return std::find(busy.begin(), busy.end(), false) != busy.end(); });
+		i = int(std::find(busy.begin(), busy.end(), false) - busy.begin());
+		busy[i] = true;
+	}
+	auto release = [this, i]() -> void
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy[i] = false;
+		}
+		available.notify_one();
+	};
+
+	std::vector<int> labels;
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		if (!wait(i, IDLE, STARTUP_TIMEOUT))
+		{	// Died while loading the model
+			stop(i);
+			start(i);
+			restarts++;
+			continue;
+		}
+
+		// Request: the cutout is preprocessed straight into the slot
+		Header& h = header(i);
+		Classifier::preprocess(plate, tensor(i));
+		std::strncpy(h.key, Classifier::hash(plate).c_str(), sizeof(h.key) - 1);
+		h.candidates = uint32_t(std::min<size_t>(candidates.size(), MAX_LABELS));
+		std::copy(candidates.begin(), candidates.begin() + h.candidates, h.candidate);
+		state(i).store(REQUEST, std::memory_order_release);
+
+		if (wait(i, DONE, timeout))
+		{
+			const int n = int(std::min<uint32_t>(h.labels, MAX_LABELS));
+			labels.assign(h.label, h.label + n);
+			if (scores) scores->assign(h.score, h.score + n);
+			state(i).store(IDLE, std::memory_order_release);
+			release();
+			return labels;
+		}
+
+		// Crashed or stuck: a fresh worker for the retry and for the next requests
+		if (DEBUG) std::cout << "Workers: restarting worker " << i << std::endl;
+		stop(i);
+		start(i);
+		restarts++;
+	}
+
+	failures++;
+	release();
+	return labels;
+}
+
+bool Workers::wait(int i, State target, std::chrono::milliseconds limit)
+{
+	const auto deadline = std::chrono::steady_clock::now() + limit;
+	while (state(i).load(std::memory_order_acquire) != target)
+	{
+		if (!alive(i) || std::chrono::steady_clock::now() > deadline) return false;
+		std::this_thread::sleep_for(POLL);
+	}
+	return true;
+}
+
+void Workers::start(int i)
+{
+	std::memset(&header(i), 0, sizeof(Header));
+	state(i).store(STARTING, std::memory_order_release);
+
+#ifdef _WIN32
+	STARTUPINFOA startup{};
+	startup.cb = sizeof(startup);
+	PROCESS_INFORMATION information{};
+	std::string command = "\"" + python + "\" \"" + script + "\" " + name + " " + std::to_string(i) + " " + std::to_string(SLOT_SIZE);
+	if (!CreateProcessA(nullptr, command.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &information))
+		throw std::runtime_error("Workers: cannot start " + command);
+	CloseHandle(information.hThread);
+	processes[i] = reinterpret_cast<intptr_t>(information.hProcess);
+#else
+	std::vector<std::string> args = { python, script, name, std::to_string(i), std::to_string(SLOT_SIZE) };
+	std::vector<char*> argv;
+	for (auto& arg : args) argv.push_back(arg.data());
+	argv.push_back(nullptr);
+	pid_t pid;
+	if (posix_spawnp(&pid, python.c_str(), nullptr, nullptr, argv.data(), environ) != 0)
+		throw std::runtime_error("Workers: cannot start " + python + " " + script);
+	processes[i] = pid;
+#endif
+}
+
+void Workers::stop(int i)
+{
+	if (!processes[i]) return;
+#ifdef _WIN32
+	HANDLE process = reinterpret_cast<HANDLE>(processes[i]);
+	if (WaitForSingleObject(process, 0) == WAIT_TIMEOUT) TerminateProcess(process, 1);
+	WaitForSingleObject(process, INFINITE);
+	CloseHandle(process);
+#else
+	if (alive(i)) kill(pid_t(processes[i]), SIGKILL);
+	if (processes[i]) waitpid(pid_t(processes[i]), nullptr, 0);
+#endif
+	processes[i] = 0;
+}
+
+bool Workers::alive(int i)
+{
+	if (!processes[i]) return false;
+#ifdef _WIN32
+	return WaitForSingleObject(reinterpret_cast<HANDLE>(processes[i]), 0) == WAIT_TIMEOUT;
+#else
+	if (waitpid(pid_t(processes[i]), nullptr, WNOHANG) == 0) return true;
+	processes[i] = 0;   // Exited and reaped
+	return false;
+#endif
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Classifier.hpp"
+
+class Workers
+{
+public:
+	/**
+	 * @brief Construct a new Workers object, a pool of CLIP worker processes each loading the model once, so that plates are labeled
+	 * concurrently instead of contending for the interpreter of the process. Each worker serves one slot of a shared memory segment:
+	 * the preprocessed cutout goes in, the labels and their scores come out. A worker that crashes or times out is restarted.
+	 * @param count The number of workers.
+	 * @param script The path of CLIP_worker.py, run by the interpreter in the CLIP_PYTHON environment variable or the default one.
+	 * @param timeout The maximum time of a request, once the worker is ready.
+	 */
+	Workers(int count = 2, const std::string& script = "./Python/CLIP_worker.py", std::chrono::milliseconds timeout = std::chrono::seconds(30));
+	~Workers();
+	Workers(const Workers&) = delete;
+	Workers& operator=(const Workers&) = delete;
+
+	/**
+	 * @brief Label a single plate cutout on the first free worker, from any thread. A failed request is retried once on the restarted worker.
+	 * @param plate The plate cutout.
+	 * @param candidates The labels the plate can have, all of them if empty.
+	 * @param scores The scores of the labels, if not null.
+	 * @return The labels of the plate, empty if the request failed.
+	 */
+	std::vector<int> classify(const cv::Mat& plate, const std::vector<int>& candidates = {}, std::vector<float>* scores = nullptr);
+
+	int getFailures() const { return failures; }
+	int getRestarts() const { return restarts; }
+
+	static constexpr int MAX_LABELS = 16;                                    // Maximum number of candidates and of labels of a request
+	static constexpr size_t HEADER_SIZE = 256;                               // Bytes of the header of a slot, before the tensor
+	static constexpr size_t SLOT_SIZE = HEADER_SIZE + 3 * Classifier::INPUT_SIZE * Classifier::INPUT_SIZE * sizeof(float);
+	static constexpr std::chrono::minutes STARTUP_TIMEOUT{ 5 };             // Maximum time to load the model (and download it on the first run)
+	static constexpr std::chrono::microseconds POLL{ 200 };                 // Time between two checks of a slot
+
+private:
+	enum State : uint32_t { IDLE, REQUEST, DONE, STOP, STARTING };
+	struct Header   // Layout shared with CLIP_worker.py
+	{
+		uint32_t state;
+		uint32_t reserved;
+		uint32_t candidates;
+		uint32_t labels;
+		uint32_t padding[4];
+		int32_t candidate[MAX_LABELS];
+		int32_t label[MAX_LABELS];
+		float score[MAX_LABELS];
+		char key[32];
+	};
+	static_assert(sizeof(Header) == HEADER_SIZE);
+
+	std::string name, script, python;     // Shared memory name, worker script and interpreter
+	std::chrono::milliseconds timeout;
+	int count;
+
+	uint8_t* memory = nullptr;            // Shared memory, one slot per worker
+	intptr_t mapping = 0;                 // Platform handle of the shared memory
+	std::vector<intptr_t> processes;      // Platform handle (or pid) of each worker process, 0 if not running
+
+	std::mutex mutex;
+	std::condition_variable available;
+	std::vector<bool> busy;               // Workers serving a request
+	std::atomic<int> failures = 0, restarts = 0;
+
+	Header& header(int i) { return *reinterpret_cast<Header*>(memory + i * SLOT_SIZE); }
+	float* tensor(int i) { return reinterpret_cast<float*>(memory + i * SLOT_SIZE + HEADER_SIZE); }
+	std::atomic_ref<uint32_t> state(int i) { return std::atomic_ref<uint32_t>(header(i).state); }
+
+	/**
+	 * @brief Wait until the slot of a worker reaches a state.
+	 * @return False if the worker died or the time ran out.
+	 */
+	bool wait(int i, State target, std::chrono::milliseconds limit);
+	void start(int i);
+	void stop(int i);
+	bool alive(int i);
+};
@@ -0,0 +1,117 @@
+#include "Writer.hpp"
+
+#include "Profiler.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#define DEBUG false
+
+Writer::Writer(unsigned int threads)
+{
+	for (unsigned int i = 0; i < threads; i++)
+		workers.emplace_back(&Writer::work, this);
+}
+
+Writer::~Writer()
+{
+	flush();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	available.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void Writer::text(const std::string& path, const std::string& content)
+{
+	Profiler::Scope scope(Profiler::OUTPUT);
+	directory(path);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back({ submitted++, path, content, cv::Mat() });
+	}
+	available.notify_one();
+}
+
+void Writer::image(const std::string& path, const cv::Mat& image)
+{
+	Profiler::Scope scope(Profiler::OUTPUT);
+	directory(path);
+	cv::Mat copy = image.clone();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back({ submitted++, path, std::string(), copy });
+	}
+	available.notify_one();
+}
+
+void Writer::flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	written.wait(lock, [this] { return next_write == submitted; });
+}
+
+size_t Writer::getFailures() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return failures;
+}
+
+void Writer::directory(const std::string& path)
+{
+	const std::string parent = std::filesystem::path(path).parent_path().string();
+	if (parent.empty()) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (directories.insert(parent).second && !std::filesystem::exists(parent))
+		std::filesystem::create_directories(parent);
+}
+
+void Writer::work()
+{
+	Profiler::Scope scope(Profiler::OUTPUT);
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			available.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (queue.empty()) return;
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		// Encode concurrently with the other threads
+		std::vector<uchar> buffer;
+		bool ok = true;
+		if (!job.image.empty())
+		{
+			try { ok = cv::imencode(std::filesystem::path(job.path).extension().string(), job.image, buffer); }
+			catch (const cv::Exception&) { ok = false; }
+		}
+
+		// Write in the submission order
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			written.wait(lock, [&] { return next_write == job.sequence; });
+		}
+		if (ok)
+		{
+			std::ofstream file(job.path, job.image.empty() ? std::ios_base::out : std::ios_base::out | std::ios_base::binary);
+			if (job.image.empty()) file.write(job.text.data(), job.text.size());
+			else file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+			ok = file.good();
+		}
+		if (!ok && DEBUG) std::cerr << "Cannot write " << job.path << std::endl;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!ok) failures++;
+			next_write++;
+		}
+		written.notify_all();
+	}
+}
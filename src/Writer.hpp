@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+class Writer
+{
+public:
+	/**
+	 * @brief Construct a new Writer object, writing the outputs in the background: images are encoded by a pool of threads, files are written in the order they were submitted.
+	 * @param threads The number of encoding threads.
+	 */
+	Writer(unsigned int threads = std::max(1u, std::thread::hardware_concurrency() / 2));
+	/**
+	 * @brief Destroy the Writer object, after writing everything still pending.
+	 */
+	~Writer();
+	Writer(const Writer&) = delete;
+	Writer& operator=(const Writer&) = delete;
+
+	/**
+	 * @brief Write a text file with a single write.
+	 * @param path The path of the file, its directory is created if needed.
+	 * @param content The whole content of the file.
+	 */
+	void text(const std::string& path, const std::string& content);
+	/**
+	 * @brief Encode and write an image, the format being given by the extension of the path.
+	 * @param path The path of the file, its directory is created if needed.
+	 * @param image The image, copied so that the caller can reuse it.
+	 */
+	void image(const std::string& path, const cv::Mat& image);
+	/**
+	 * @brief Wait until everything submitted so far is written.
+	 */
+	void flush();
+	/**
+	 * @brief Number of files that could not be encoded or written.
+	 */
+	size_t getFailures() const;
+
+private:
+	struct Job
+	{
+		size_t sequence;     // Submission order, which is also the write order
+		std::string path;    // Destination file
+		std::string text;    // Content of a text job
+		cv::Mat image;       // Content of an image job, empty for text jobs
+	};
+
+	/**
+	 * @brief Create the directory of a file, checking each directory only once.
+	 * @param path The path of the file.
+	 */
+	void directory(const std::string& path);
+	/**
+	 * @brief Loop of the encoding threads.
+	 */
+	void work();
+
+	mutable std::mutex mutex;
+	std::condition_variable available;   // Signaled when a job is queued or the writer stops
+	std::condition_variable written;     // Signaled when a file is written
+	std::deque<Job> queue;               // Jobs not taken yet by a thread
+	size_t submitted = 0;                // Number of jobs submitted
+	size_t next_write = 0;               // Sequence of the next job to write
+	size_t failures = 0;                 // Jobs that failed
+	bool stopping = false;
+	std::set<std::string> directories;   // Directories already created or checked
+	std::vector<std::thread> workers;
+};
@@ -9,23 +9,41 @@
 #include "BoundingBoxes.hpp"
 #include "Segmentation.hpp"
 #include "Metrics.hpp"
-
+#include "Evaluation.hpp"
+#include "Cache.hpp"
+#include "Utils.hpp"
+#include "Tray.hpp"
+#include "Classifier.hpp"
+#include "Writer.hpp"
+#include "Profiler.hpp"
+#include "Context.hpp"
+#include "Video.hpp"
+#include "Matcher.hpp"
+#include "Workers.hpp"
+#include "Session.hpp"
+#include "ThreadBudget.hpp"
+
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <queue>
 #include <string>
 #include <vector>
 #include <cmath>
+#include <cstdlib>
 #include <format>
+#include <future>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc.hpp>
 
-#include <Python.h>
-
 #define DEBUG false   // debug mode to check code logic
-#define SKIP false    // avoid CLIP processing to save time while developing
+#define CACHE true    // reuse the results of the stages whose inputs and parameters did not change
+#define MATCHING false // label the easy plates with the gallery matcher, only the ambiguous ones with CLIP: enable once --validate-matching agrees
 
 using namespace std;
 
@@ -33,8 +51,67 @@ using namespace std;
 // While reading the code make sure to collapse lambda functions.
 // They were intended for such purpose and for you to hide away things that are not important to the main logic.
 
-int main()
+int main(int argc, char** argv)
 {	
+	// Options: --profile to profile the memory of the stages, --scale <factor> to process the images at a reduced resolution
+	// --video <file or camera index> to process a continuous capture instead of the dataset, --workers <n> to label the dataset plates in n CLIP processes
+	// --cores <n> to budget n cores among OpenCV, PyTorch and the writer instead of the whole machine, --pin to pin the process to them
+	// --deadline <ms> to skip the bread, salad and beans refinements of a captured tray that would not end in time
+	// --tray <directory> to estimate the leftovers of a single tray online, each leftover image as soon as it is processed
+	// --evaluate <directory>... to only evaluate the outputs of previous runs against the ground truth, loaded once, into one report
+	// --shard <k>/<n> to process every n-th tray from the k-th and write the metrics partial of the shard instead of the reports
+	// --merge <partial>... to only write the reports of the merged partials of the shards, the same as of a single run over their trays
+	// --validate-matching to only compare the labels the matcher accepts on the dataset plates with the ones of CLIP, failing on any difference
+	bool PROFILE = false;
+	double SCALE = 1.0;
+	string VIDEO;
+	int WORKERS = 0;
+	int CORES = 0;
+	bool PIN = false;
+	int DEADLINE = 0;
+	string TRAY;
+	vector<string> EVALUATE;
+	int SHARD = 1, SHARDS = 1;
+	vector<string> MERGE;
+	bool VALIDATE_MATCHING = false;
+	for (int a = 1; a < argc; a++)
+	{
+		if (string(argv[a]) == "--profile") PROFILE = true;
+		else if (string(argv[a]) == "--scale" && a + 1 < argc) SCALE = stod(argv[++a]);
+		else if (string(argv[a]) == "--video" && a + 1 < argc) VIDEO = argv[++a];
+		else if (string(argv[a]) == "--workers" && a + 1 < argc) WORKERS = stoi(argv[++a]);
+		else if (string(argv[a]) == "--cores" && a + 1 < argc) CORES = stoi(argv[++a]);
+		else if (string(argv[a]) == "--pin") PIN = true;
+		else if (string(argv[a]) == "--deadline" && a + 1 < argc) DEADLINE = stoi(argv[++a]);
+		else if (string(argv[a]) == "--tray" && a + 1 < argc) TRAY = argv[++a];
+		else if (string(argv[a]) == "--evaluate")
+			while (a + 1 < argc && string(argv[a + 1]).rfind("--", 0) != 0)
+			{
+				string run = argv[++a];
+				EVALUATE.push_back(run.back() == '/' || run.back() == '\\' ? run : run + "/");
+			}
+		else if (string(argv[a]) == "--shard" && a + 1 < argc)
+		{
+			const string shard = argv[++a];
+			SHARD = stoi(shard.substr(0, shard.find('/')));
+			SHARDS = stoi(shard.substr(shard.find('/') + 1));
+		}
+		else if (string(argv[a]) == "--merge")
+			while (a + 1 < argc && string(argv[a + 1]).rfind("--", 0) != 0)
+				MERGE.push_back(argv[++a]);
+		else if (string(argv[a]) == "--validate-matching") VALIDATE_MATCHING = true;
+	}
+	if (SHARDS < 1 || SHARD < 1 || SHARD > SHARDS)
+	{
+		cerr << "Invalid shard " << SHARD << "/" << SHARDS << endl;
+		return 1;
+	}
+	if (WORKERS > 0 && (!VIDEO.empty() || !TRAY.empty() || VALIDATE_MATCHING))
+	{
+		cerr << "--workers only labels the dataset plates, not with --video, --tray or --validate-matching" << endl;
+		return 1;
+	}
+
 	// Variables
 	const string           DATASET_PATH      =   "./Food_leftover_dataset/";						        // 
 	const int              NUMBER_OF_TRAYS   =   8;														    //     ____        __  __        
@@ -43,92 +120,213 @@ int main()
 	const string           BREAD_PATH        =   "./bread/";											    //  / ____/ /_/ / /_/ / / (__  ) 
 	const string           LABELS_PATH       =   "./labels/";											    // /_/    \__,_/\__/_/ /_/____/  
 	const string           BREAD_OUT_PATH    =   "./bread_output/";										    //                               
-	const string           OUTPUT_PATH       =   "./output/";											    // 
+	const string           OUTPUT_PATH       =   SCALE == 1.0 ? "./output/" : "./output_" + to_string(SCALE).substr(0, 4) + "/";   // one per scale, to compare their metrics
+	const string           CACHE_PATH        =   "./cache/";											    // 
+	const string           CLIP_PATH         =   "./Python/CLIP_interface.py";							    // 
 	vector<vector<tuple<                   // for each tray, for each image, tuple that contains:
 			cv::Mat,                       // found mask
 			vector<pair<int, cv::Rect>>,   // found boxes = vector of <class, bounding box>
 			cv::Mat,                       // ground truth mask
 			vector<pair<int, cv::Rect>>    // ground truth boxes = vector of <class, bounding box>
 		>>> metrics;                       // name of this abomination is metrics
-	auto cutout = [](const cv::Mat& image, const cv::Vec3f& circle) -> cv::Mat
-	{
-		const int x = cvRound(circle[0] - circle[2]) > 0 ? cvRound(circle[0] - circle[2]) : 0;
-		const int y = cvRound(circle[1] - circle[2]) > 0 ? cvRound(circle[1] - circle[2]) : 0;
-		const int w = x + cvRound(2 * circle[2]) < image.cols ? cvRound(2 * circle[2]) : image.cols - x;
-		const int h = y + cvRound(2 * circle[2]) < image.rows ? cvRound(2 * circle[2]) : image.rows - y;
-		
-		//return image inside circle
-		cv::Mat mask = cv::Mat::zeros(image.size(), CV_8UC1);
-		cv::circle(mask, cv::Point(cvRound(circle[0]), cvRound(circle[1])), cvRound(circle[2]), cv::Scalar(255), -1);
-		cv::Mat res;
-		image.copyTo(res, mask);
-		return res(cv::Rect(x,y,w,h));
-
-	};
+	vector<int> metrics_trays;             // number of the tray of each element of metrics, a subset of them in a shard
 	auto display = [](const cv::Mat& image) -> void
 	{
 		cv::namedWindow("Display window", cv::WINDOW_AUTOSIZE);
 		cv::imshow("Display window", image);
 		cv::waitKey(0);
 	};
-	auto process = [](cv::Mat& mask) -> cv::Mat
+
+	// Evaluation only: no pipeline, no CLIP
+	if (!EVALUATE.empty())
+	{
+		const Evaluation evaluation(DATASET_PATH, NUMBER_OF_TRAYS);
+		filesystem::create_directories(OUTPUT_PATH);
+		const int failures = evaluation.compare(EVALUATE, OUTPUT_PATH + "evaluation.txt");
+		cout << EVALUATE.size() - failures << " of " << EVALUATE.size() << " runs evaluated, report in " << OUTPUT_PATH << "evaluation.txt" << endl;
+		return failures > 0 ? 1 : 0;
+	}
+
+	// Merge only: the reports of the shards, no pipeline, no CLIP
+	if (!MERGE.empty())
 	{
-		// Variables
-		cv::Mat output = cv::Mat::zeros(mask.size(), CV_8UC1);
-		const unsigned int BLUR_STRENGTH = 5;
-		const unsigned int INITIAL_KERNEL_SIZE = 40;
-		const unsigned int AREA_THRESHOLD = 8000;
-		const unsigned int KERNEL_SIZE = 15;
-		auto filterAreas = [](const cv::Mat& input, cv::Mat& output, const unsigned int threshold) -> void
+		vector<Metrics::Partial> partials;
+		for (const auto& file : MERGE)
 		{
-			vector<vector<cv::Point>> c;
-
-			cv::findContours(input.clone(), c, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-			for (int i = 0; i < c.size(); i++)
-				if (cv::contourArea(c[i]) > threshold)
-					cv::drawContours(output, c, i, 255, -1);
-		};
-		auto fillHoles = [](cv::Mat& input) -> void
+			vector<Metrics::Partial> shard = Metrics::load(file);
+			partials.insert(partials.end(), shard.begin(), shard.end());
+		}
+
+		// The reports are the ones of a single run only over all the trays, each exactly once
+		vector<int> trays(partials.size());
+		for (int t = 0; t < partials.size(); t++) trays[t] = partials[t].tray;
+		sort(trays.begin(), trays.end());
+		string missing, repeated, unknown;
+		for (int i = 1; i <= NUMBER_OF_TRAYS; i++)
 		{
-			cv::Mat ff = input.clone();
-			cv::floodFill(ff, cv::Point(0, 0), cv::Scalar(255));
-			cv::Mat inversed_ff;
-			cv::bitwise_not(ff, inversed_ff);
-			input = (input | inversed_ff);
-		};
-
-		// Morphological operations
-		cv::medianBlur(mask, mask, BLUR_STRENGTH);
-		cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(INITIAL_KERNEL_SIZE, INITIAL_KERNEL_SIZE)));
-		filterAreas(mask, output, AREA_THRESHOLD);
-		cv::dilate(output, output, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(KERNEL_SIZE, KERNEL_SIZE)));
-		cv::morphologyEx(output, output, cv::MORPH_CLOSE, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(KERNEL_SIZE, KERNEL_SIZE)));
-		fillHoles(output);
-
-		return output;
-	};
+			const auto n = count(trays.begin(), trays.end(), i);
+			if (n == 0) missing += " " + to_string(i);
+			if (n > 1) repeated += " " + to_string(i);
+		}
+		for (const auto tray : trays)
+			if (tray < 1 || tray > NUMBER_OF_TRAYS) unknown += " " + to_string(tray);
+		if (!missing.empty() || !repeated.empty() || !unknown.empty())
+		{
+			cerr << "The partials do not cover trays 1 to " << NUMBER_OF_TRAYS << " exactly once:" << (missing.empty() ? "" : " missing" + missing)
+				<< (repeated.empty() ? "" : " repeated" + repeated) << (unknown.empty() ? "" : " unknown" + unknown) << endl;
+			return 1;
+		}
+		filesystem::create_directories(OUTPUT_PATH);
+		Metrics m(partials, OUTPUT_PATH);
+		cout << partials.size() << " trays merged from " << MERGE.size() << " partials, reports in " << OUTPUT_PATH << endl;
+		return 0;
+	}
+
+	// Memory profiling of the stages
+	if (PROFILE) Profiler::enable();
+	string profile;   // Summaries of the allocations of each unit of work
+
+	// Thread budget: applied before the interpreters start, so that they and the CLIP processes inherit it.
+	// Only the interpreters that classify share the cores: the pool labels every plate when started, the embedded CLIP otherwise
+	const int INTERPRETERS = WORKERS > 0 ? WORKERS : 1;
+	ThreadBudget budget(CORES, 1, INTERPRETERS, PIN);
+	budget.apply();
+	cout << budget.report() << endl;
 
 	// Python initialization for CLIP
-	Py_Initialize();											   //
-	PyEval_InitThreads();										   //
-	PyRun_SimpleString("import sys");							   //     ____        __  __
-	PyRun_SimpleString("sys.path.append('./Python/')");	           //    / __ \__  __/ /_/ /_  ____  ____
-	PyRun_SimpleString("sys.argv = ['CLIP_interface.py']");		   //   / /_/ / / / / __/ __ \/ __ \/ __ \*
-	PyObject* pName = PyUnicode_FromString("CLIP_interface");	   //  / ____/ /_/ / /_/ / / / /_/ / / / /
-	PyObject* pModule = PyImport_ImportModule("CLIP_interface");   // /_/    \__, /\__/_/ /_/\____/_/ /_/
-	PyObject* pFunc = PyObject_GetAttrString(pModule, "plates");   //       /____/
-	PyObject* pArgs = PyTuple_New(1);							   //
+	Classifier::initialize("./Python/");   //     ____        __  __
+	Classifier clip;                       //    / __ \__  __/ /_/ /_  ____  ____
+	                                       //   / /_/ / / / / __/ __ \/ __ \/ __ \*
+	                                       //  / ____/ /_/ / /_/ / / / /_/ / / / /
+	                                       // /_/    \__, /\__/_/ /_/\____/_/ /_/
+	                                       //       /____/
+
+	// Cache of the stage results, content-addressed by input hashes and stage parameters
+	Cache cache(CACHE_PATH);
+	const string CLIP_HASH = Cache::hashFile(CLIP_PATH);
+	auto environment = [](const char* name, const string& fallback) -> string
+	{	// Setting read by CLIP_interface from the environment, with its default there
+		const char* value = getenv(name);
+		return value ? value : fallback;
+	};
+	const string CLIP_SETTINGS = environment("CLIP_PRECISION", "fp32") + ";" + environment("CLIP_WEIGHTS_PATH", "./ViT-B-32.safetensors");   // Change the labels too
+
+	// Colour index of the matching gallery, built once and saved next to it, only when something matches
+	const unique_ptr<const Matcher> matcher = MATCHING || VALIDATE_MATCHING ? make_unique<const Matcher>() : nullptr;
+
+	// Matching validation only: every plate the matcher would label must get the same labels from CLIP
+	if (VALIDATE_MATCHING)
+	{
+		int accepted = 0, disagreements = 0;
+		for (int i = 1; i <= NUMBER_OF_TRAYS; i++)
+			for (const auto& imgname : IMAGE_NAMES)
+			{
+				const string path = DATASET_PATH + "tray" + to_string(i) + "/" + imgname + ".jpg";
+				cv::Mat image = cv::imread(path);
+				if (image.empty()) continue;
+				vector<cv::Vec3f> plates, bowls;
+				BoundingBoxes::detectCircles(image, plates, bowls);
+				for (const auto& circle : plates)
+				{
+					const cv::Mat plate = utils::cutout(image, circle);
+					vector<int> matched;
+					if (!matcher->match(plate, {}, matched)) continue;
+					accepted++;
+					const vector<int> labels = clip.classify(plate);
+					if (labels != matched)
+					{
+						disagreements++;
+						cerr << path << " plate at (" << circle[0] << ", " << circle[1] << "): matcher " << matched[0] << ", CLIP";
+						for (const auto label : labels) cerr << " " << label;
+						cerr << endl;
+					}
+				}
+			}
+		cout << accepted - disagreements << " of " << accepted << " plates labeled by the matcher agree with CLIP ("
+			<< matcher->getRejected() << " left to CLIP)" << endl;
+		Classifier::finalize();
+		return disagreements > 0 ? 1 : 0;
+	}
+
+	// Optional pool of CLIP processes, so that the plates of an image set (only the ambiguous ones when matching) are labeled concurrently
+	unique_ptr<Workers> workers = WORKERS > 0 ? make_unique<Workers>(WORKERS) : nullptr;
+
+	// Outputs are encoded and written in the background, in order
+	Writer writer(budget.getWriterThreads());
+
+	// Lookup tables, structuring elements and pixel parameters for the processing scale
+	const Resources resources(SCALE);
+	auto read = [SCALE](const string& path, cv::Size& size) -> cv::Mat
+	{	// Read an image at the processing scale, returning its original size
+		cv::Mat image = cv::imread(path);
+		size = image.size();
+		if (SCALE != 1.0) cv::resize(image, image, cv::Size(), SCALE, SCALE, cv::INTER_AREA);
+		return image;
+	};
+
+	auto write_skipped = [&writer](const string& path, const vector<string>& skipped) -> void
+	{	// Coarse mask: the refinements skipped to meet the deadline, no file if none was
+		if (skipped.empty()) return;
+		string skipped_text;
+		for (const auto& step : skipped)
+			skipped_text += (skipped_text.empty() ? "" : "\n") + step;
+		writer.text(path, skipped_text);
+	};
+
+	// Continuous capture: only the frames where a new tray settled go through the pipeline
+	if (!VIDEO.empty())
+	{
+		Context context(true, SCALE, chrono::milliseconds(DEADLINE));
+		Video video(VIDEO, context, [&](int frame, const cv::Mat&, const Context::Result& result) -> void
+		{
+			string boxes_text;
+			for (const auto& box : result.boxes)
+				boxes_text += (boxes_text.empty() ? "" : "\n") + string("ID: ") + to_string(box.first) + "; [" + to_string(box.second.x) + ", " + to_string(box.second.y) + ", " + to_string(box.second.width) + ", " + to_string(box.second.height) + "]";
+			writer.text(OUTPUT_PATH + "video/frame" + to_string(frame) + "_bounding_boxes.txt", boxes_text);
+			writer.image(OUTPUT_PATH + "video/frame" + to_string(frame) + "_mask.png", result.mask);
+			write_skipped(OUTPUT_PATH + "video/frame" + to_string(frame) + "_skipped.txt", result.skipped);
+		});
+		cout << video.getFrames() << " frames: " << video.getProcessed() << " processed, " << video.getReused() << " reused" << endl;
+		writer.flush();
+		if (writer.getFailures() > 0) cout << writer.getFailures() << " output files could not be written" << endl;
+		Classifier::finalize();
+		return 0;
+	}
+
+	// Online leftover estimation: the food image is processed once, then each leftover image is estimated on its own
+	if (!TRAY.empty())
+	{
+		Context context(true, SCALE, chrono::milliseconds(DEADLINE));
+		Session session(context, cv::imread(TRAY + "/food_image.jpg"));
+		writer.image(OUTPUT_PATH + "session/food_image_mask.png", session.getFood().mask);
+		write_skipped(OUTPUT_PATH + "session/food_image_skipped.txt", session.getFood().skipped);
+		for (const auto& imgname : IMAGE_NAMES)
+		{
+			if (imgname == "food_image" || !filesystem::exists(TRAY + "/" + imgname + ".jpg")) continue;
+			const Session::Leftover left = session.leftover(cv::imread(TRAY + "/" + imgname + ".jpg"));
+			string ratios_text;
+			for (const auto& [label, ratio] : left.ratios)
+				ratios_text += (ratios_text.empty() ? "" : "\n") + string("Food ") + to_string(label) + ": " + to_string(ratio);
+			cout << imgname << endl << ratios_text << endl;
+			writer.text(OUTPUT_PATH + "session/" + imgname + "_leftover.txt", ratios_text);
+			writer.image(OUTPUT_PATH + "session/" + imgname + "_mask.png", left.result.mask);
+			write_skipped(OUTPUT_PATH + "session/" + imgname + "_skipped.txt", left.result.skipped);
+		}
+		writer.flush();
+		if (writer.getFailures() > 0) cout << writer.getFailures() << " output files could not be written" << endl;
+		Classifier::finalize();
+		return 0;
+	}
 
 	// START OF THE MAIN LOOP
-	if (!filesystem::exists(PLATES_PATH)) filesystem::create_directory(PLATES_PATH); 
 	if (!filesystem::exists(OUTPUT_PATH)) filesystem::create_directory(OUTPUT_PATH);
 	if (!filesystem::exists(BREAD_PATH)) filesystem::create_directory(BREAD_PATH);
 
 	for (int i = 1; i <= NUMBER_OF_TRAYS; i++)
 	{	// For each tray [i]
+		if ((i - 1) % SHARDS != SHARD - 1) continue;   // Tray of another shard
+		metrics_trays.push_back(i);
 		metrics.push_back(vector<tuple<cv::Mat, vector<pair<int, cv::Rect>>, cv::Mat, vector<pair<int, cv::Rect>>>>());   // Create a vector of metrics for each tray [i]
-		if (!filesystem::exists(PLATES_PATH + "tray" + to_string(i) + "/")) filesystem::create_directory(PLATES_PATH + "tray" + to_string(i) + "/");
-		if (!filesystem::exists(OUTPUT_PATH + "tray" + to_string(i) + "/")) filesystem::create_directory(OUTPUT_PATH + "tray" + to_string(i) + "/");
 		if (!filesystem::exists(BREAD_PATH + "tray" + to_string(i) + "/")) filesystem::create_directory(BREAD_PATH + "tray" + to_string(i) + "/");
 
 		queue<BoundingBoxes> bb;   // Queue of BoundingBoxes objects: create them now and pop them later when processing
@@ -147,43 +345,116 @@ int main()
 		// Read images and create BoundingBoxes objects
 		for (const auto& imgname : IMAGE_NAMES)
 		{	// For each image 'imgname' in tray [i]
-			if (!filesystem::exists(PLATES_PATH + "tray" + to_string(i) + "/" + imgname + "/")) filesystem::create_directory(PLATES_PATH + "tray" + to_string(i) + "/" + imgname + "/");
+			filesystem::remove_all(PLATES_PATH + "tray" + to_string(i) + "/" + imgname + "/");         // No stale cutouts of a previous run, maybe at another scale
+			filesystem::create_directories(PLATES_PATH + "tray" + to_string(i) + "/" + imgname + "/");   // Even without plates, as it is globbed below
 			if (!filesystem::exists(BREAD_PATH + "tray" + to_string(i) + "/" + imgname + "/")) filesystem::create_directory(BREAD_PATH + "tray" + to_string(i) + "/" + imgname + "/");
 			
-			cv::Mat image = cv::imread(DATASET_PATH + "tray" + to_string(i) + "/" + imgname + ".jpg");   // Read the image
-			bb.push(BoundingBoxes(image));                                                               // Push the BoundingBoxes object into the queue
+			cv::Size original_size;
+			cv::Mat image = read(DATASET_PATH + "tray" + to_string(i) + "/" + imgname + ".jpg", original_size);   // Read the image
+
+			// Push the BoundingBoxes object into the queue, restoring it from the cache if the image and the parameters did not change
+			const string key = Cache::key({ Cache::hashFile(DATASET_PATH + "tray" + to_string(i) + "/" + imgname + ".jpg"), BoundingBoxes::parameters(), to_string(SCALE) });
+			vector<cv::Vec3f> cached_plates;
+			pair<bool, cv::Vec3f> cached_salad;
+			pair<bool, cv::Mat> cached_bread;
+			if (CACHE && cache.getBoundingBoxes(key, cached_plates, cached_salad, cached_bread))
+				bb.push(BoundingBoxes(image, cached_plates, cached_salad, cached_bread));
+			else
+			{
+				bb.push(BoundingBoxes(image, resources));
+				cache.putBoundingBoxes(key, bb.back());
+			}
 			
 			// Save plates cutouts
 			vector<cv::Vec3f> plates = bb.back().getPlates();
 			for (int j = 0; j < plates.size(); j++)
-				cv::imwrite(PLATES_PATH + "tray" + to_string(i) + "/" + imgname + "/plate" + to_string(j) + ".jpg", cutout(image, plates[j]));
+				writer.image(PLATES_PATH + "tray" + to_string(i) + "/" + imgname + "/plate" + to_string(j) + ".jpg", utils::cutout(image, plates[j]));
+		}
+		writer.flush();   // The cutouts must be on disk before being hashed and labeled
+		if (PROFILE) profile += Profiler::checkpoint("tray" + to_string(i) + " detection");
+
+		// The labels of the tray only depend on its plates cutouts and on the CLIP script
+		vector<string> tray_files;                                                             // Paths of the plates cutouts of the tray
+		vector<string> tray_parts = { CLIP_HASH, CLIP_SETTINGS, MATCHING ? matcher->parameters() : workers ? "cutouts" : "" };   // Inputs of the labeling stage
+		for (const auto& imgname : IMAGE_NAMES)
+		{	// For each image 'imgname' in tray [i]
+			vector<string> files;
+			cv::glob(PLATES_PATH + "tray" + to_string(i) + "/" + imgname + "/*.jpg", files);
+			for (const auto& file : files)
+			{
+				tray_files.push_back(file);
+				tray_parts.push_back(file.substr(PLATES_PATH.length()) + ":" + Cache::hashFile(file));
+			}
 		}
+		const string labels_key = Cache::key(tray_parts);
 
-		// Just ugly testing (slightly faster with pre-computed stuff), we ALWAYS want to enter here!
-		if (!SKIP)
+		map<string, vector<int>> tray_labels;   // Labels of each plate cutout, by path relative to PLATES_PATH
+		if (!CACHE || !cache.getLabels(labels_key, tray_labels))
 		{	// Plates segmentation using CLIP
-			if (DEBUG) cout << "Running Python script..." << endl;
-			PyObject* pValue = PyLong_FromLong(i);
-			PyTuple_SetItem(pArgs, 0, pValue);
-			PyObject_CallObject(pFunc, pArgs);
-			if (DEBUG) cout << "Python script finished" << endl;
+			if (MATCHING || workers)
+			{	// One cutout at a time, food image first: its labels are the candidates of the leftovers, as in CLIP_interface.process_tray
+				vector<int> tray_candidates;
+				for (const bool leftovers : { false, true })
+				{
+					vector<pair<string, future<vector<int>>>> ambiguous;   // Plates left to CLIP, concurrently with the workers
+					for (const auto& file : tray_files)
+					{
+						const string name = file.substr(PLATES_PATH.length());
+						if ((name.find("/food_image/") == string::npos) != leftovers) continue;
+						const vector<int> candidates = leftovers ? tray_candidates : vector<int>();
+						const cv::Mat plate = cv::imread(file);
+						if (!MATCHING || !matcher->match(plate, candidates, tray_labels[name]))
+							ambiguous.emplace_back(name, async(workers ? launch::async : launch::deferred, [&clip, &workers, plate, candidates]() -> vector<int>
+							{
+								return workers ? workers->classify(plate, candidates) : clip.classify(plate, candidates);
+							}));
+					}
+					for (auto& [name, task] : ambiguous)
+						tray_labels[name] = task.get();
+
+					if (!leftovers)
+						for (const auto& file : tray_files)
+						{
+							const string name = file.substr(PLATES_PATH.length());
+							if (name.find("/food_image/") == string::npos) continue;
+							for (const auto label : tray_labels[name])
+								if (find(tray_candidates.begin(), tray_candidates.end(), label) == tray_candidates.end()) tray_candidates.push_back(label);
+						}
+				}
+			}
+			else
+			{
+				if (DEBUG) cout << "Running Python script..." << endl;
+				clip.plates(i);
+				if (DEBUG) cout << "Python script finished" << endl;
+
+				for (const auto& file : tray_files)
+				{	// Read the labels from the files computed by CLIP
+					const string name = file.substr(PLATES_PATH.length());
+					ifstream infile(LABELS_PATH + name + ".txt");
+					string category;
+					while (getline(infile, category)) tray_labels[name].push_back(stoi(category));
+					infile.close();
+				}
+			}
+			cache.putLabels(labels_key, tray_labels);
 		}
+		if (PROFILE) profile += Profiler::checkpoint("tray" + to_string(i) + " labels");
 
 		// Compute final masks and bounding boxes for each image
 		for (const auto& imgname : IMAGE_NAMES)
 		{	// For each image 'imgname' in tray [i]
-			cv::Mat image = cv::imread(DATASET_PATH + "tray" + to_string(i) + "/" + imgname + ".jpg");   // Read the image
-			vector<cv::Vec3f> plates = bb.front().getPlates();                                           // Get the plates from the queue
-			pair<bool, cv::Vec3f> salad = bb.front().getSalad();                                         // Get the salad from the queue
-			pair<bool, cv::Mat> bread = bb.front().getBread();                                           // Get the bread from the queue
+			cv::Size original_size;
+			cv::Mat image = read(DATASET_PATH + "tray" + to_string(i) + "/" + imgname + ".jpg", original_size);   // Read the image
+			BoundingBoxes detection = bb.front();                                                        // Get the plates, salad and bread from the queue
+			vector<cv::Vec3f> plates = detection.getPlates();                                            // Get the plates
 			bb.pop();                                                                                    // Pop the BoundingBoxes object from the queue
 			
 			vector<string> files;                                                              // Vector of strings containing the paths of the plates in the image
 			cv::glob(PLATES_PATH + "tray" + to_string(i) + "/" + imgname + "/*.jpg", files);   // Get the paths of the plates in the image
 
-			cv::Mat tray_mask = cv::Mat::zeros(image.size(), CV_8UC1);   // Create the tray mask
-			vector<string> boxes;                                        // Vector of strings containing the bounding boxes of the plates in the image
-			vector<pair<int, cv::Rect>> tray_boxes;                      // Final bounding boxes of the plates in the image
+			vector<cv::Mat> plates_masks(files.size());                        // Masks of the segments of each plate
+			vector<vector<pair<int, cv::Rect>>> plates_boxes(files.size());    // Bounding boxes of the segments of each plate, wrt the plate cutout
 
 			//     ____  __      __           
 			//    / __ \/ /___ _/ /____  _____
@@ -191,139 +462,48 @@ int main()
 			//  / ____/ / /_/ / /_/  __(__  ) 
 			// /_/   /_/\__,_/\__/\___/____/  
 			// 
-			// PLATES: Process each plate in the image
+			// PLATES: Process each plate in the image, the plates not found in the cache concurrently
+			vector<string> keys(files.size());                       // Cache keys of the plates
+			vector<future<Segmentation>> segmentations(files.size());   // Segmentations of the plates not found in the cache
 			for (int j = 0; j < files.size(); j++)
 			{	// For each plate [j] in the image 'imgname' of tray [i]
-				ifstream infile(LABELS_PATH + files[j].substr(PLATES_PATH.length(), files[j].length() - 1) + ".txt");
-
-				vector<int> labels;                                                  // Vector of integers containing the labels of the segments in the plate [j]
-				string category;	                                                 // String containing the label of each segment in the plate [j]
-				while (getline(infile, category)) labels.push_back(stoi(category));  // Read the labels from the file previously computed by CLIP
-				infile.close();                                                      // Close the file
-
-				// Segmentate the plate [j] and get the bounding boxes of the segments
-				cv::Mat plate_image = cv::imread(files[j]);         // Read the plate [j]
-				Segmentation seg(plate_image, labels);		        // Create a Segmentation object
-				cv::Mat mask = seg.getSegments();			        // Get the mask of the segments
-				vector<pair<int, cv::Rect>> box = seg.getBoxes();   // Get the bounding boxes of the segments
-				for (int k = 0; k < box.size(); k++)
-				{   // For each bounding box [k] in the plate [j]
-					int label = box[k].first;                                // Get the label of the segment
-					int x = box[k].second.x + plates[j][0] - plates[j][2];   // Get the x coordinate of the bounding box wrt the true image
-					int y = box[k].second.y + plates[j][1] - plates[j][2];   // Get the y coordinate of the bounding box wrt the true image
-					int w = box[k].second.width;                             // Get the width of the bounding box
-					int h = box[k].second.height;                            // Get the height of the bounding box
-
-					boxes.push_back("ID: " + to_string(label) + "; [" + to_string(x) + ", " + to_string(y) + ", " + to_string(w) + ", " + to_string(h) + "]");
-					tray_boxes.push_back(make_pair(label, cv::Rect(x, y, w, h)));
-				}
-
-				// Add the mask of the plate [j] to the tray mask
-				for (int k = 0; k < mask.rows; k++)   // For each row [k] in the mask
-					for (int l = 0; l < mask.cols; l++)   // For each column [l] in the mask
-						if (pow(k - plates[j][2], 2) + pow(l - plates[j][2], 2) <= pow(plates[j][2], 2))   // Replace in the tray mask only the pixels inside the plate [j], not the whole rectangle
-							if (k + plates[j][1] - plates[j][2] >= 0 && k + plates[j][1] - plates[j][2] < tray_mask.rows && l + plates[j][0] - plates[j][2] >= 0 && l + plates[j][0] - plates[j][2] < tray_mask.cols)
-								tray_mask.at<uchar>(k + plates[j][1] - plates[j][2], l + plates[j][0] - plates[j][2]) = mask.at<uchar>(k,l);
+				vector<int> labels = tray_labels[files[j].substr(PLATES_PATH.length())];   // Labels of the segments in the plate [j], previously computed by CLIP
+
+				// Segmentate the plate [j] and get the bounding boxes of the segments, unless the cutout, the labels and the parameters did not change
+				string labels_string;
+				for (const auto label : labels) labels_string += to_string(label) + ",";
+				keys[j] = Cache::key({ Cache::hashFile(files[j]), labels_string, Segmentation::parameters(), to_string(SCALE) });
+
+				if (!CACHE || !cache.getSegments(keys[j], plates_masks[j], plates_boxes[j]))
+					segmentations[j] = ThreadBudget::spawn([file = files[j], labels, &resources]() -> Segmentation
+					{
+						cv::Mat plate_image = cv::imread(file);   // Read the plate [j]
+						return Segmentation(plate_image, labels, resources);  // Create a Segmentation object
+					});
 			}
-
-			if (DEBUG) { cv::imshow("tray_mask", tray_mask * 15); cv::waitKey(0); }
-
-			//    _____       __          __
-			//   / ___/____ _/ /___ _____/ /
-			//   \__ \/ __ `/ / __ `/ __  / 
-			//  ___/ / /_/ / / /_/ / /_/ /  
-			// /____/\__,_/_/\__,_/\__,_/   
-			//                              
-			// SALAD: Process the salad in the image
-			if (salad.first)
-			{	// If the salad is present in the image
-				const int LABEL = 12;                                // Label of the salad
-				const unsigned int SATURATION_THRESHOLD = 206;       // Saturation threshold
-				cv::Mat salad_image = cutout(image, salad.second);   // Cut out the salad from the image
-
-				// Gamma correction
-				cv::Mat gamma;
-				cv::Mat lookUpTable(1, 256, CV_8U);
-				uchar* p = lookUpTable.ptr();
-				double gamma_ = 0.5;
-				for (int i = 0; i < 256; ++i)
-					p[i] = cv::saturate_cast<uchar>(pow(i / 255.0, gamma_) * 255.0);
-				cv::LUT(salad_image, lookUpTable, gamma);
-
-				// HSV equalization
-				cv::Mat hsv;
-				cv::cvtColor(gamma, hsv, cv::COLOR_BGR2HSV);
-				vector<cv::Mat> hsv_channels;
-				cv::split(hsv, hsv_channels);
-				cv::equalizeHist(hsv_channels[1], hsv_channels[1]);
-
-				// Thresholding
-				cv::Mat mask;
-				cv::threshold(hsv_channels[1], mask, SATURATION_THRESHOLD, LABEL, cv::THRESH_BINARY);
-				
-				// Morphological operations
-				mask = process(mask);
-				cv::threshold(mask, mask, 0, LABEL, cv::THRESH_BINARY);   // Thresholding again to the correct label
-
-				// Find the bounding box of the salad
-				vector<vector<cv::Point>> contours;                                             // Vector of vectors of points containing the contours of the salad
-				cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);   // Find the contours of the salad
-				vector<cv::Rect> box(contours.size());									        // Vector of rectangles containing the bounding boxes of the salad
-				
-				for (int i = 0; i < contours.size(); i++)
-					box[i] = cv::boundingRect(contours[i]);  // Get the bounding boxes of the salad
-				auto min = min_element(box.begin(), box.end(), [](const cv::Rect& a, const cv::Rect& b) { return a.area() < b.area(); });   // Get the smallest bounding box
-
-				int x = min->x + salad.second[0] - salad.second[2];   // Get the x coordinate of the bounding box wrt the true image
-				int y = min->y + salad.second[1] - salad.second[2];   // Get the y coordinate of the bounding box wrt the true image
-				int w = min->width;                                   // Get the width of the bounding box
-				int h = min->height;                                  // Get the height of the bounding box
-
-				boxes.push_back("ID: " + to_string(LABEL) + "; [" + to_string(x) + ", " + to_string(y) + ", " + to_string(w) + ", " + to_string(h) + "]");
-				tray_boxes.push_back(make_pair(LABEL, cv::Rect(x, y, w, h)));
-
-				// Add the mask of the salad to the tray mask
-				for (int k = 0; k < mask.rows; k++)   // For each row [k] in the mask
-					for (int l = 0; l < mask.cols; l++)   // For each column [l] in the mask
-						if (pow(k - salad.second[2],2) + pow(l - salad.second[2],2) <= pow(salad.second[2],2))   // Replace in the tray mask only the pixels inside the salad, not the whole rectangle
-							if (k + salad.second[1] - salad.second[2] >= 0 && k + salad.second[1] - salad.second[2] < tray_mask.rows && l + salad.second[0] - salad.second[2] >= 0 && l + salad.second[0] - salad.second[2] < tray_mask.cols)
-								tray_mask.at<uchar>(k + salad.second[1] - salad.second[2], l + salad.second[0] - salad.second[2]) = mask.at<uchar>(k, l);
-
-				if (DEBUG) { cv::imshow("w/salad", tray_mask * 15); cv::waitKey(0); }
+			for (int j = 0; j < files.size(); j++)
+			{	// Collect the segmentations in the order of the plates
+				if (!segmentations[j].valid()) continue;
+				Segmentation seg = segmentations[j].get();
+				plates_masks[j] = seg.getSegments();   // Get the mask of the segments
+				plates_boxes[j] = seg.getBoxes();      // Get the bounding boxes of the segments
+				cache.putSegments(keys[j], plates_masks[j], plates_boxes[j]);
 			}
 
-			//     ____                      __
-			//    / __ )________  ____ _____/ /
-			//   / __  / ___/ _ \/ __ `/ __  / 
-			//  / /_/ / /  /  __/ /_/ / /_/ /  
-			// /_____/_/   \___/\__,_/\__,_/   
-			//                                 
-			// BREAD: Process the bread in the image
-			if (bread.first)
-			{	// If the bread is present in the image
-				const int LABEL = 13;   // Label of the bread, as defined in the assignment
-
-				cv::Mat bread_mask;
-				cv::threshold(bread.second, bread_mask, 0, LABEL, cv::THRESH_BINARY);   // Thresholding to the correct label
-				
-				// Bounding box
-				vector<vector<cv::Point>> contours;
-				cv::findContours(bread_mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-				cv::Rect box = cv::boundingRect(contours[0]);
-
-				// Coordinates
-				int x = box.x;
-				int y = box.y;
-				int w = box.width;
-				int h = box.height;
-
-				// Add the bounding box to the list of bounding boxes
-				boxes.push_back("ID: " + to_string(LABEL) + "; [" + to_string(x) + ", " + to_string(y) + ", " + to_string(w) + ", " + to_string(h) + "]");
-				tray_boxes.push_back(make_pair(LABEL, cv::Rect(x, y, w, h)));
-				tray_mask = tray_mask + bread_mask;
-
-				if (DEBUG) cv::imshow("w/bread", tray_mask * 15); cv::waitKey(0);
-			}
+			//   ______          
+			//  /_  __/________ ___  __
+			//   / / / ___/ __ `/ / / /
+			//  / / / /  / /_/ / /_/ / 
+			// /_/ /_/   \__,_/\__, /  
+			//               /____/   
+			// TRAY: Compose plates, salad and bread into the final mask and bounding boxes
+			Tray tray(image, detection, plates_masks, plates_boxes, resources);
+			cv::Mat tray_mask = tray.getMask();                           // Final mask of the image
+			vector<pair<int, cv::Rect>> tray_boxes = tray.getBoxes();     // Final bounding boxes of the image
+			utils::rescale(tray_mask, tray_boxes, original_size);         // Back to the original resolution
+			vector<string> boxes;                                         // Vector of strings containing the bounding boxes of the image
+			for (const auto& box : tray_boxes)
+				boxes.push_back("ID: " + to_string(box.first) + "; [" + to_string(box.second.x) + ", " + to_string(box.second.y) + ", " + to_string(box.second.width) + ", " + to_string(box.second.height) + "]");
 
 			//    __	 
 			//  /    \	 Second informative STOP sign.
@@ -336,22 +516,16 @@ int main()
 			//    ||	 don't worry about it
 			//  ~~~~~~~	 
 			// Write bounding boxes to file
-			if (!filesystem::exists(OUTPUT_PATH + "tray" + to_string(i) + "/bounding_boxes/")) filesystem::create_directory(OUTPUT_PATH + "tray" + to_string(i) + "/bounding_boxes/");
+			string boxes_text;   // Whole content of the file, written at once
 			for (int k = 0; k < boxes.size(); k++)
 			{   // For each bounding box [k] in the image 'imgname' in tray [i]
 				if (DEBUG) cout << imgname + " " + boxes[k] << endl;
-
-				ofstream file;
-				string path = OUTPUT_PATH + "tray" + to_string(i) + "/bounding_boxes/" + imgname + "_bounding_boxes.txt";
-
-				k == 0 ? file = ofstream(path) : file = ofstream(path, ios_base::app);
-				if (file.is_open())
-					k < boxes.size() - 1 ? file << boxes[k] << endl : file << boxes[k];
+				boxes_text += k < boxes.size() - 1 ? boxes[k] + "\n" : boxes[k];
 			}
+			writer.text(OUTPUT_PATH + "tray" + to_string(i) + "/bounding_boxes/" + imgname + "_bounding_boxes.txt", boxes_text);
 
 			// Write tray mask to file
-			if (!filesystem::exists(OUTPUT_PATH + "tray" + to_string(i) + "/masks/")) filesystem::create_directory(OUTPUT_PATH + "tray" + to_string(i) + "/masks/");
-			cv::imwrite(OUTPUT_PATH + "tray" + to_string(i) + "/masks/" + imgname + "_mask.png", tray_mask);
+			writer.image(OUTPUT_PATH + "tray" + to_string(i) + "/masks/" + imgname + "_mask.png", tray_mask);
 
 			// METRICS: update the 'metrics' vector
 			const string BOXES_PATH = DATASET_PATH + "tray" + to_string(i) + "/bounding_boxes/" + imgname + "_bounding_box.txt";
@@ -359,30 +533,10 @@ int main()
 			if (imgname == "food_image") MASK_PATH += "_mask";
 			MASK_PATH += ".png";
 
-			vector<pair<int, cv::Rect>> original_boxes;   // Vector of pairs to store the original boxes from the assignment
-			ifstream file(BOXES_PATH);
-			if (file.is_open())
-			{
-				string line;   // Line read from the file
-				while (getline(file, line))
-				{   // For each line 'line' in the file
-					int id_start = line.find(":") + 2;    // Start of the id in the line
-					int id_end = line.find(";");          // End of the id in the line
-					int box_start = line.find("[") + 1;   // Start of the box in the line
-					int box_end = line.find("]");         // End of the box in the line
-
-					string id = line.substr(id_start, id_end - id_start);      // Extract the id
-					string box = line.substr(box_start, box_end - box_start);  // Extract the box
-
-					istringstream iss(box);                                                               // Create a string stream from the box
-					vector<string> tokens{ istream_iterator<string>{iss}, istream_iterator<string>{} };   // Split the box into tokens
-					cv::Rect tmp(stoi(tokens[0]), stoi(tokens[1]), stoi(tokens[2]), stoi(tokens[3]));     // Create a rectangle from the box
-					original_boxes.push_back(make_pair(stoi(id), tmp));                                   // Add the pair to the vector
-				}
-				file.close();
-			}
+			vector<pair<int, cv::Rect>> original_boxes = utils::readBoxes(BOXES_PATH);                    // Original boxes from the assignment
 			cv::Mat original_mask = cv::imread(MASK_PATH, cv::IMREAD_GRAYSCALE);                          // Read the mask in GRAYSCALE mode
 			metrics.back().push_back(make_tuple(tray_mask, tray_boxes, original_mask, original_boxes));   // Add the metric to the vector
+			if (PROFILE) profile += Profiler::checkpoint("tray" + to_string(i) + "/" + imgname);
 		}
 	}
 
@@ -399,10 +553,30 @@ int main()
 	//  `'(_ )_)(_)_)'				    
 	//								    
 	// METRICS: compute the metrics
-	Metrics m(metrics);
+	{
+		Profiler::Scope scope(Profiler::METRICS);
+		if (SHARDS > 1)
+		{	// Partial of the shard, merged with the others by --merge
+			vector<Metrics::Partial> partials;
+			for (int t = 0; t < metrics.size(); t++)
+				partials.push_back(Metrics::partial(metrics[t], metrics_trays[t]));
+			Metrics::save(partials, OUTPUT_PATH + "partial" + to_string(SHARD) + "of" + to_string(SHARDS) + ".yml");
+		}
+		else
+			Metrics m(metrics, OUTPUT_PATH);
+	}
+	if (PROFILE)
+	{	// Write the memory profile
+		profile += Profiler::checkpoint("metrics");
+		writer.text(OUTPUT_PATH + "memory_profile.txt", profile);
+	}
+	writer.flush();
+	if (writer.getFailures() > 0) cout << writer.getFailures() << " output files could not be written" << endl;
+	if (workers && workers->getFailures() > 0) cout << workers->getFailures() << " plates could not be labeled by the CLIP workers" << endl;
+	if (MATCHING && DEBUG) cout << matcher->getAccepted() << " plates labeled by the matcher, " << matcher->getRejected() << " by CLIP" << endl;
 
 	// Python finalization
-	Py_Finalize();
+	Classifier::finalize();
 
 	cout << "You got here, all is good :)" << endl;
 